@@ -0,0 +1,184 @@
+#!/usr/bin/env bash
+
+set -euo pipefail
+
+BOLD=$(tput bold 2>/dev/null || true)
+NORMAL=$(tput sgr0 2>/dev/null || true)
+
+log_info() {
+  echo -e "${BOLD}bench.sh INFO: $@${NORMAL}" >&2
+}
+
+usage() {
+    cat <<USAGE
+Generates synthetic inputs and reports how long the program takes to check each of them (best of several runs). Results
+are printed and also written to bench_output.txt.
+
+usage: $0 --bin \$path_to_binary [--lines N] [--runs N] [--perf-counters]
+
+flags:
+  --bin:   path to the binary under test
+  --lines: number of statements in each generated input (default: 200000)
+  --runs:  number of times each input is checked, the fastest run is reported (default: 5)
+  --perf-counters: also check each input once with --perf-counters and report the per phase hardware counters
+USAGE
+}
+
+# prints the number of microseconds elapsed while running the given command
+time_run() {
+  local start end
+  start=$(date +%s%N)
+  "$@" > /dev/null 2>&1 || true # swallow errors
+  end=$(date +%s%N)
+  echo $(( (end - start) / 1000 ))
+}
+
+bench() {
+  local bin="$1"
+  local runs="$2"
+  local name="$3"
+  local input="$4"
+
+  local best=''
+  for (( i = 0; i < runs; i++ ))
+  do
+    local us
+    us=$(time_run "$bin" "$input")
+    if [[ -z "$best" || "$us" -lt "$best" ]]
+    then
+      best="$us"
+    fi
+  done
+
+  local bytes
+  bytes=$(wc -c < "$input")
+  printf '%-24s %12d bytes %10d us %10.1f MB/s\n' "$name" "$bytes" "$best" \
+    "$(awk -v b="$bytes" -v us="$best" 'BEGIN { print (us > 0) ? b / us : 0 }')"
+}
+
+# checks a program of many modules with 1 to 64 threads. the modules declare the same names, so the threads intern
+# mostly names that another thread already has
+bench_jobs() {
+  local bin="$1"
+  local runs="$2"
+  local dir="$3"
+
+  local bytes
+  bytes=$(cat "$dir"/*.ts | wc -c)
+  for jobs in 1 2 4 8 16 32 64
+  do
+    local best=''
+    for (( i = 0; i < runs; i++ ))
+    do
+      local us
+      us=$(time_run "$bin" --jobs "$jobs" "$dir"/*.ts)
+      if [[ -z "$best" || "$us" -lt "$best" ]]
+      then
+        best="$us"
+      fi
+    done
+    printf '%-24s %12d bytes %10d us %10.1f MB/s\n' "modules_jobs_$jobs" "$bytes" "$best" \
+      "$(awk -v b="$bytes" -v us="$best" 'BEGIN { print (us > 0) ? b / us : 0 }')"
+  done
+}
+
+# prints the per phase hardware counters of checking the given input
+perf_counters() {
+  local bin="$1"
+  local name="$2"
+  local input="$3"
+
+  echo
+  echo "$name:"
+  "$bin" --perf-counters "$input" 2> >(grep 'performance counters' >&2) || true
+}
+
+main() {
+  if [[ $# -lt 1 ]]
+  then
+    usage
+    exit 1
+  fi
+
+  local bin
+  local lines=200000
+  local runs=5
+  local perf=false
+  while [[ $# -gt 0 ]]
+  do
+    local key="$1"
+    case "$key" in
+    help | --usage | --help)
+      usage
+      exit
+      ;;
+    --bin)
+      bin="$2"
+      shift 2
+      ;;
+    --lines)
+      lines="$2"
+      shift 2
+      ;;
+    --runs)
+      runs="$2"
+      shift 2
+      ;;
+    --perf-counters)
+      perf=true
+      shift
+      ;;
+    *)
+      echo "unrecognised argument '$key'. run \`$0 help\` to display usage information"
+      exit 1
+      ;;
+    esac
+  done
+
+  if [[ ! -x "$bin" ]]
+  then
+    echo "no such executable '$bin'"
+    exit 1
+  fi
+
+  local tmpdir
+  tmpdir=$(mktemp -d /tmp/single_pass_tsc_bench.XXXXXX)
+
+  log_info "generating inputs with $lines statements"
+  awk -v n="$lines" 'BEGIN {
+    print "let first_identifier_name = 1;"
+    print "let second_identifier_name: number = first_identifier_name;"
+    for (i = 0; i < n; i++) print "first_identifier_name = second_identifier_name = first_identifier_name = 12345;"
+  }' > "$tmpdir/ascii_identifiers.ts"
+  awk -v n="$lines" 'BEGIN {
+    print "let größe_der_eingabe = 1;"
+    print "let 入力の大きさ: number = größe_der_eingabe;"
+    for (i = 0; i < n; i++) print "größe_der_eingabe = 入力の大きさ = größe_der_eingabe = 12345;"
+  }' > "$tmpdir/utf8_identifiers.ts"
+  mkdir "$tmpdir/modules"
+  awk -v n="$lines" -v dir="$tmpdir/modules" 'BEGIN {
+    print "export let shared_counter = 0;" > (dir "/common.ts")
+    print "export type Shared = number;" > (dir "/common.ts")
+    for (m = 0; m < 256; m++) {
+      file = dir "/module_" m ".ts"
+      print "import { shared_counter, Shared } from \"./common\";" > file
+      for (i = 0; i < n / 256; i++) print "let generated_identifier_" i ": Shared = shared_counter;" > file
+      close(file)
+    }
+  }'
+
+  {
+    bench "$bin" "$runs" ascii_identifiers "$tmpdir/ascii_identifiers.ts"
+    bench "$bin" "$runs" utf8_identifiers "$tmpdir/utf8_identifiers.ts"
+    bench_jobs "$bin" "$runs" "$tmpdir/modules"
+    if [[ "$perf" == true ]]
+    then
+      perf_counters "$bin" ascii_identifiers "$tmpdir/ascii_identifiers.ts"
+      perf_counters "$bin" utf8_identifiers "$tmpdir/utf8_identifiers.ts"
+    fi
+  } | tee bench_output.txt
+
+  rm -rf "$tmpdir"
+}
+
+main "$@"
@@ -0,0 +1,178 @@
+#!/usr/bin/env bash
+
+set -euo pipefail
+
+BOLD=$(tput bold 2>/dev/null || true)
+NORMAL=$(tput sgr0 2>/dev/null || true)
+
+log_info() {
+  echo -e "${BOLD}complexity_test.sh INFO: $@${NORMAL}" >&2
+}
+
+usage() {
+    cat <<USAGE
+Generates adversarial inputs at sizes N, 2N, 4N and 8N and checks each of them (best of several runs). For every kind of
+input, the growth of the time with the size is fitted as N^k, and the test fails if k is above the allowed exponent, so
+that a path that turns quadratic is caught even when the inputs in the snapshot tests are too small to notice.
+
+usage: $0 --bin \$path_to_binary [--n N] [--runs N] [--max-exponent K]
+
+flags:
+  --bin:          path to the binary under test
+  --n:            size of the smallest input, in statements or nesting levels (default: 50000)
+  --runs:         number of times each input is checked, the fastest run is used (default: 3)
+  --max-exponent: the largest exponent that counts as near linear (default: 1.3)
+USAGE
+}
+
+# prints the number of microseconds elapsed while running the given command
+time_run() {
+  local start end
+  start=$(date +%s%N)
+  "$@" > /dev/null 2>&1 || true # the error storm fails on purpose
+  end=$(date +%s%N)
+  echo $(( (end - start) / 1000 ))
+}
+
+# many distinct names in one scope
+gen_many_declarations() {
+  awk -v n="$1" 'BEGIN {
+    for (i = 0; i < n; i++) print "let declaration_" i " = " i ";"
+    print "let last: number = declaration_0;"
+  }'
+}
+
+# every binding is initialized with the previous one, and each annotation makes its type be inferred
+gen_ident_chain() {
+  awk -v n="$1" 'BEGIN {
+    print "let chain_0 = 0;"
+    for (i = 1; i < n; i++) print "let chain_" i ": number = chain_" i - 1 ";"
+  }'
+}
+
+# a single expression with n assignments
+gen_assignment_chain() {
+  awk -v n="$1" 'BEGIN {
+    print "let target = 0;"
+    for (i = 0; i < n; i++) printf "target = "
+    print "1;"
+  }'
+}
+
+# n statements on a single line
+gen_long_line() {
+  awk -v n="$1" 'BEGIN {
+    print "let target = 0;"
+    for (i = 0; i < n; i++) printf "target = 12345; "
+    print ""
+  }'
+}
+
+# n type errors on a single line, each of which is reported with the line it is on
+gen_error_storm() {
+  awk -v n="$1" 'BEGIN {
+    for (i = 0; i < n; i++) printf "let storm_" i ": boolean = 1; "
+    print ""
+  }'
+}
+
+main() {
+  if [[ $# -lt 1 ]]
+  then
+    usage
+    exit 1
+  fi
+
+  local bin
+  local n=50000
+  local runs=3
+  local max_exponent=1.3
+  while [[ $# -gt 0 ]]
+  do
+    local key="$1"
+    case "$key" in
+    help | --usage | --help)
+      usage
+      exit
+      ;;
+    --bin)
+      bin="$2"
+      shift 2
+      ;;
+    --n)
+      n="$2"
+      shift 2
+      ;;
+    --runs)
+      runs="$2"
+      shift 2
+      ;;
+    --max-exponent)
+      max_exponent="$2"
+      shift 2
+      ;;
+    *)
+      echo "unrecognised argument '$key'. run \`$0 help\` to display usage information"
+      exit 1
+      ;;
+    esac
+  done
+
+  if [[ ! -x "$bin" ]]
+  then
+    echo "no such executable '$bin'"
+    exit 1
+  fi
+
+  local tmpdir
+  tmpdir=$(mktemp -d /tmp/single_pass_tsc_complexity.XXXXXX)
+  trap "rm -rf '$tmpdir'" EXIT
+
+  local failed=()
+  for kind in many_declarations ident_chain assignment_chain long_line error_storm
+  do
+    log_info "checking $kind inputs of size $n to $(( n * 8 ))"
+    local first='' last=''
+    for scale in 1 2 4 8
+    do
+      local size=$(( n * scale ))
+      local input="$tmpdir/$kind.ts"
+      "gen_$kind" "$size" > "$input"
+
+      local best=''
+      for (( i = 0; i < runs; i++ ))
+      do
+        local us
+        us=$(time_run "$bin" --max-depth $(( size + 1 )) "$input")
+        if [[ -z "$best" || "$us" -lt "$best" ]]
+        then
+          best="$us"
+        fi
+      done
+      printf '%-24s %10d %10d us\n' "$kind" "$size" "$best"
+
+      if [[ -z "$first" ]]
+      then
+        first="$best"
+      fi
+      last="$best"
+    done
+
+    # the sizes span three doublings, so t(8N) / t(N) = 8^k
+    local exponent
+    exponent=$(awk -v a="$first" -v b="$last" 'BEGIN { printf "%.2f", log((b > 0 ? b : 1) / (a > 0 ? a : 1)) / log(8) }')
+    printf '%-24s grows as N^%s\n' "$kind" "$exponent"
+    if awk -v k="$exponent" -v max="$max_exponent" 'BEGIN { exit !(k > max) }'
+    then
+      failed+=("$kind")
+    fi
+  done
+
+  if [[ ${#failed[@]} -gt 0 ]]
+  then
+    echo "grows faster than N^$max_exponent: ${failed[*]}"
+    exit 1
+  fi
+}
+
+main "$@"
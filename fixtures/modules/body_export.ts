@@ -0,0 +1,5 @@
+function count(n: number): number {
+	export let leaked = 1;
+	return n;
+}
+export let kept = 2;
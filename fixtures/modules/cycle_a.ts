@@ -0,0 +1,2 @@
+import { b } from "./cycle_b";
+export let a = b;
@@ -0,0 +1,2 @@
+import { a } from "./cycle_a";
+export let b = 1;
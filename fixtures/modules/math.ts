@@ -0,0 +1,4 @@
+export let zero = 0;
+export let yes: boolean = true;
+export type Num = number;
+let hidden = 1;
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""
+Generates unicode_tables.h: the non-ASCII code point ranges of the Unicode ID_Start and ID_Continue properties, used by
+the lexer to classify UTF-8 identifiers. ASCII is classified by hand in main.c, so it is left out of the tables.
+
+The properties are derived from general categories as described in UAX #31:
+
+    ID_Start    = Lu + Ll + Lt + Lm + Lo + Nl + Other_ID_Start - Pattern_Syntax - Pattern_White_Space
+    ID_Continue = ID_Start + Mn + Mc + Nd + Pc + Other_ID_Continue - Pattern_Syntax - Pattern_White_Space
+
+usage: ./gen_unicode_tables.py > unicode_tables.h
+"""
+
+import sys
+import unicodedata
+
+ID_START_CATEGORIES = {"Lu", "Ll", "Lt", "Lm", "Lo", "Nl"}
+ID_CONTINUE_CATEGORIES = ID_START_CATEGORIES | {"Mn", "Mc", "Nd", "Pc"}
+
+OTHER_ID_START = {0x1885, 0x1886, 0x2118, 0x212E, 0x309B, 0x309C}
+OTHER_ID_CONTINUE = {0x00B7, 0x0387, 0x19DA} | set(range(0x1369, 0x1372))
+
+# the only Pattern_Syntax code point that would otherwise be picked up by the categories above (U+2E2F VERTICAL TILDE, Lm)
+PATTERN_SYNTAX = {0x2E2F}
+
+
+def ranges(pred):
+    out = []
+    start = None
+    for cp in range(0x80, sys.maxunicode + 2):
+        inside = cp <= sys.maxunicode and pred(cp)
+        if inside and start is None:
+            start = cp
+        elif not inside and start is not None:
+            out.append((start, cp - 1))
+            start = None
+    return out
+
+
+def is_id_start(cp):
+    if cp in PATTERN_SYNTAX:
+        return False
+    return cp in OTHER_ID_START or unicodedata.category(chr(cp)) in ID_START_CATEGORIES
+
+
+def is_id_continue(cp):
+    if cp in PATTERN_SYNTAX:
+        return False
+    return (
+        is_id_start(cp)
+        or cp in OTHER_ID_CONTINUE
+        or unicodedata.category(chr(cp)) in ID_CONTINUE_CATEGORIES
+    )
+
+
+def emit(name, rs):
+    print(f"static const uint32_t {name}[][2] = {{")
+    for i in range(0, len(rs), 4):
+        row = ", ".join(f"{{ 0x{lo:05X}, 0x{hi:05X} }}" for lo, hi in rs[i:i + 4])
+        print(f"\t{row},")
+    print("};")
+    print()
+
+
+def main():
+    print("#pragma once")
+    print()
+    print(f"// generated by gen_unicode_tables.py from Unicode {unicodedata.unidata_version}, do not edit by hand")
+    print("// sorted, non-overlapping inclusive ranges of non-ASCII code points")
+    print()
+    print("#include <stdint.h>")
+    print()
+    emit("unicode_id_start_ranges", ranges(is_id_start))
+    emit("unicode_id_continue_ranges", ranges(is_id_continue))
+
+
+if __name__ == "__main__":
+    main()
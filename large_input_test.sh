@@ -0,0 +1,117 @@
+#!/usr/bin/env bash
+
+set -euo pipefail
+
+BOLD=$(tput bold 2>/dev/null || true)
+NORMAL=$(tput sgr0 2>/dev/null || true)
+
+log_info() {
+  echo -e "${BOLD}large_input_test.sh INFO: $@${NORMAL}" >&2
+}
+
+usage() {
+    cat <<USAGE
+Generates a single input larger than 4 GiB whose very last statement has a type error, checks it with --stream and
+verifies that the error is reported on that statement, which fails if any size or offset on the way wraps around at 32
+bits. The throughput of the check is reported. The input is deleted afterwards.
+
+usage: $0 --bin \$path_to_binary [--dir DIR] [--mib N]
+
+flags:
+  --bin: path to the binary under test
+  --dir: directory to generate the input in, which needs enough free space for it (default: /tmp)
+  --mib: size of the padding before the last statement in MiB (default: 4160, just over 4 GiB)
+USAGE
+}
+
+main() {
+  if [[ $# -lt 1 ]]
+  then
+    usage
+    exit 1
+  fi
+
+  local bin
+  local dir=/tmp
+  local mib=4160
+  while [[ $# -gt 0 ]]
+  do
+    local key="$1"
+    case "$key" in
+    help | --usage | --help)
+      usage
+      exit
+      ;;
+    --bin)
+      bin="$2"
+      shift 2
+      ;;
+    --dir)
+      dir="$2"
+      shift 2
+      ;;
+    --mib)
+      mib="$2"
+      shift 2
+      ;;
+    *)
+      echo "unrecognised argument '$key'. run \`$0 help\` to display usage information"
+      exit 1
+      ;;
+    esac
+  done
+
+  if [[ ! -x "$bin" ]]
+  then
+    echo "no such executable '$bin'"
+    exit 1
+  fi
+
+  local free_mib
+  free_mib=$(df -Pm "$dir" | awk 'NR == 2 { print $4 }')
+  if [[ "$free_mib" -lt $(( mib + 64 )) ]]
+  then
+    echo "'$dir' has only $free_mib MiB free, but the input needs $mib MiB"
+    exit 1
+  fi
+
+  local tmpdir
+  tmpdir=$(mktemp -d "$dir/single_pass_tsc_large.XXXXXX")
+  trap "rm -rf '$tmpdir'" EXIT
+
+  # one MiB of 64 byte statements, which is appended to the input over and over
+  log_info "generating a $mib MiB input"
+  awk 'BEGIN { for (i = 0; i < 16384; i++) printf "padding = 12345;%47s\n", "" }' > "$tmpdir/block.ts"
+  local input="$tmpdir/large.ts"
+  {
+    echo 'let padding = 0;'
+    for (( i = 0; i < mib; i++ ))
+    do
+      cat "$tmpdir/block.ts"
+    done
+    echo 'let last: boolean = padding;'
+  } > "$input"
+
+  local bytes
+  bytes=$(stat -c %s "$input")
+  log_info "checking $bytes bytes"
+
+  local start end status=0
+  start=$(date +%s%N)
+  "$bin" --stream "$input" > "$tmpdir/stdout" 2> "$tmpdir/stderr" || status=$?
+  end=$(date +%s%N)
+
+  if [[ "$status" -eq 0 ]] || ! grep -q '^let last: boolean = padding;$' "$tmpdir/stderr" ||
+    ! grep -q 'type mismatch' "$tmpdir/stderr"
+  then
+    echo "expected a type mismatch on the last statement, got exit status $status and:"
+    cat "$tmpdir/stderr"
+    exit 1
+  fi
+
+  local us=$(( (end - start) / 1000 ))
+  printf '%-24s %12d bytes %10d us %10.1f MB/s\n' large_input "$bytes" "$us" \
+    "$(awk -v b="$bytes" -v us="$us" 'BEGIN { print (us > 0) ? b / us : 0 }')"
+}
+
+main "$@"
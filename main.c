@@ -1,1026 +1,6345 @@
+#define _GNU_SOURCE
+
 #include <ctype.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef __linux__
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#include "./unicode_tables.h"
 #include "./vendor/stretchy_buffer.h"
 
+// phases that hardware counters are attributed to with --perf-counters. counts are exclusive: a phase entered while
+// another one is running is charged for its own events only, e.g. lookups done while inferring a type
 typedef enum
 {
-	TOK_FUNCTION,
-	TOK_LET,
-	TOK_TYPE,
-	TOK_RETURN,
-	TOK_EQ,
-	TOK_NUMBER,
-	TOK_BOOL,
-	TOK_IDENT,
-	TOK_SEMICOLON,
-	TOK_COLON,
-	TOK_END_OF_FILE,
-	TOK_UNKNOWN,
-} TokenKind;
+	PERF_PHASE_OTHER,
+	PERF_PHASE_READ,
+	PERF_PHASE_LEX,
+	PERF_PHASE_LOOKUP,
+	PERF_PHASE_INFER,
+	PERF_PHASE_COUNT,
+} PerfPhase;
 
-char *token_kind_name(TokenKind kind)
-{
-	switch (kind)
-	{
-	case TOK_FUNCTION:
-		return "TOK_FUNCTION";
-	case TOK_LET:
-		return "TOK_LET";
-	case TOK_TYPE:
-		return "TOK_TYPE";
-	case TOK_RETURN:
-		return "TOK_RETURN";
-	case TOK_EQ:
-		return "TOK_EQ";
-	case TOK_NUMBER:
-		return "TOK_NUMBER";
-	case TOK_BOOL:
-		return "TOK_BOOL";
-	case TOK_IDENT:
-		return "TOK_IDENT";
-	case TOK_SEMICOLON:
-		return "TOK_SEMICOLON";
-	case TOK_COLON:
-		return "TOK_COLON";
-	case TOK_END_OF_FILE:
-		return "TOK_END_OF_FILE";
-	case TOK_UNKNOWN:
-		return "TOK_UNKNOWN";
-	default:
-		return "(unknown token kind)";
-	}
-}
+const char *perf_phase_names[PERF_PHASE_COUNT] = { "other", "read", "lex", "lookup", "infer" };
 
-typedef struct
+typedef enum
 {
-	TokenKind kind;
-	char *text;
-} Token;
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_BRANCH_MISSES,
+	PERF_L1D_MISSES,
+	PERF_LLC_MISSES,
+	PERF_PAGE_FAULTS,
+	PERF_COUNTER_COUNT,
+} PerfCounter;
+
+const char *perf_counter_names[PERF_COUNTER_COUNT] = {
+	"cycles", "instructions", "branch-misses", "L1d-misses", "LLC-misses", "page-faults",
+};
 
-Token *token_create(TokenKind kind, char *text)
-{
-	Token *token = malloc(sizeof(Token));
-	token->kind = kind;
-	token->text = text;
-	return token;
-}
+#define PERF_MAX_DEPTH 16
 
-typedef struct
-{
-	Token *prev_token;
-	Token *token;
-	size_t pos;
-	const char *source;
-	size_t source_len;
-} Lexer;
+typedef struct PerfThread_ PerfThread;
 
-Lexer *lexer_create(const char *source)
+// the counters of one thread. a counter only counts the thread that opened it, so every thread that enters a phase
+// opens its own group
+struct PerfThread_
 {
-	Lexer *lexer = malloc(sizeof(Lexer));
-	lexer->token = NULL;
-	lexer->prev_token = NULL;
-	lexer->pos = 0;
-	lexer->source = source;
-	lexer->source_len = strlen(source);
-	return lexer;
-}
+	int group_fd;
+	// the counter itself, or -1 if it could not be opened
+	int fds[PERF_COUNTER_COUNT];
+	// position of each counter in a read of the group, or -1 if it could not be opened
+	int slot[PERF_COUNTER_COUNT];
+	int slot_count;
+	uint64_t last[PERF_COUNTER_COUNT];
+	PerfPhase stack[PERF_MAX_DEPTH];
+	int depth;
+	uint64_t totals[PERF_PHASE_COUNT][PERF_COUNTER_COUNT];
+	PerfThread *next;
+};
 
-bool lexer_has_more_chars(Lexer *lexer)
+bool perf_enabled = false;
+pthread_mutex_t perf_lock = PTHREAD_MUTEX_INITIALIZER;
+PerfThread *perf_threads = NULL;
+_Thread_local PerfThread *perf_thread = NULL;
+// what the threads that have already finished counted, see perf_thread_close
+uint64_t perf_finished_totals[PERF_PHASE_COUNT][PERF_COUNTER_COUNT];
+bool perf_finished_available[PERF_COUNTER_COUNT];
+
+// opens the counters of the calling thread. counters the kernel refuses are left out, and if it refuses all of them
+// group_fd is -1 and errno tells why
+PerfThread *perf_thread_open(void)
 {
-	return lexer->pos < lexer->source_len;
-}
+	PerfThread *t = calloc(1, sizeof(PerfThread));
+	t->group_fd = -1;
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+	{
+		t->fds[i] = -1;
+	}
+	int err = ENOSYS;
+#ifdef __linux__
+	const struct
+	{
+		uint32_t type;
+		uint64_t config;
+	} events[PERF_COUNTER_COUNT] = {
+		[PERF_CYCLES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		[PERF_INSTRUCTIONS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+		[PERF_BRANCH_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+		[PERF_L1D_MISSES] = { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+			| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+		[PERF_LLC_MISSES] = { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+			| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+		[PERF_PAGE_FAULTS] = { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+	};
 
-char lexer_char(Lexer *lexer)
-{
-	return lexer->source[lexer->pos];
-}
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+	{
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = events[i].type;
+		attr.config = events[i].config;
+		// user space only: it is all that an unprivileged process may count, and it keeps the cost of reading the
+		// counters out of the phases
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP;
+
+		int fd = syscall(SYS_perf_event_open, &attr, 0, -1, t->group_fd, 0);
+		if (fd < 0)
+		{
+			err = errno;
+			t->slot[i] = -1;
+			continue;
+		}
+		if (t->group_fd < 0)
+		{
+			t->group_fd = fd;
+		}
+		t->fds[i] = fd;
+		t->slot[i] = t->slot_count++;
+	}
+#else
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+	{
+		t->slot[i] = -1;
+	}
+#endif
 
-char *substr(const char *orig, size_t from, size_t to)
-{
-	size_t len = to - from;
-	char *sub = calloc(len + 1, sizeof(char));
-	strncpy(sub, orig + from, len);
-	sub[len] = '\0';
-	return sub;
-}
+	if (t->group_fd < 0)
+	{
+		errno = err;
+		return t;
+	}
 
-bool is_digit(char c)
-{
-	return '0' <= c && c <= '9';
+	pthread_mutex_lock(&perf_lock);
+	t->next = perf_threads;
+	perf_threads = t;
+	pthread_mutex_unlock(&perf_lock);
+	return t;
 }
 
-bool is_alpha(char c)
+void perf_thread_read(PerfThread *t, uint64_t *values)
 {
-	return ('A' <= c && c <= 'Z') || ('a' <= c && c <= 'z');
+	// the layout of a group read is { nr, values[nr] }
+	uint64_t buf[1 + PERF_COUNTER_COUNT] = { 0 };
+	if (read(t->group_fd, buf, sizeof(buf)) < 0)
+	{
+		memcpy(values, t->last, sizeof(t->last));
+		return;
+	}
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+	{
+		values[i] = t->slot[i] < 0 ? 0 : buf[1 + t->slot[i]];
+	}
 }
 
-bool is_alphanumeric(char c)
+// charges everything counted since the last read to the phase on top of the stack
+void perf_thread_charge(PerfThread *t)
 {
-	return is_alpha(c) || is_digit(c);
+	uint64_t now[PERF_COUNTER_COUNT];
+	perf_thread_read(t, now);
+	// phases nested deeper than the stack are charged to the deepest one it holds
+	int top = t->depth > PERF_MAX_DEPTH ? PERF_MAX_DEPTH : t->depth;
+	PerfPhase phase = top == 0 ? PERF_PHASE_OTHER : t->stack[top - 1];
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+	{
+		t->totals[phase][i] += now[i] - t->last[i];
+		t->last[i] = now[i];
+	}
 }
 
-bool is_identifier_char(char c)
+PerfThread *perf_current_thread(void)
 {
-	return is_alphanumeric(c) || c == '_';
+	if (perf_thread == NULL)
+	{
+		perf_thread = perf_thread_open();
+		if (perf_thread->group_fd >= 0)
+		{
+			perf_thread_read(perf_thread, perf_thread->last);
+		}
+	}
+	return perf_thread->group_fd >= 0 ? perf_thread : NULL;
 }
 
-void lexer_set_token(Lexer *lexer, Token *token)
+void perf_enter(PerfPhase phase)
 {
-	if (lexer->prev_token != NULL)
+	if (!perf_enabled)
 	{
-		free(lexer->prev_token);
+		return;
+	}
+	PerfThread *t = perf_current_thread();
+	if (t == NULL)
+	{
+		return;
 	}
-	lexer->prev_token = lexer->token;
-	lexer->token = token;
-}
 
-#define STRNCMP(s1, s2) (strncmp(s1, s2, sizeof(s2) - 1) == 0)
+	perf_thread_charge(t);
+	if (t->depth < PERF_MAX_DEPTH)
+	{
+		t->stack[t->depth] = phase;
+	}
+	t->depth++;
+}
 
-void lexer_scan(Lexer *lexer)
+void perf_exit(void)
 {
-	if (lexer->token != NULL && lexer->token->kind == TOK_END_OF_FILE)
+	if (!perf_enabled)
+	{
+		return;
+	}
+	PerfThread *t = perf_current_thread();
+	if (t == NULL)
 	{
 		return;
 	}
 
-	while (lexer_has_more_chars(lexer) && isspace(lexer_char(lexer)))
+	perf_thread_charge(t);
+	t->depth--;
+}
+
+// charges the events of the calling thread since its last phase change. threads call this before they finish
+void perf_flush(void)
+{
+	if (perf_enabled && perf_thread != NULL && perf_thread->group_fd >= 0)
 	{
-		lexer->pos++;
+		perf_thread_charge(perf_thread);
 	}
+}
 
-	size_t start = lexer->pos;
-	if (!lexer_has_more_chars(lexer))
+// charges the last events of the calling thread and closes its counters, keeping what they counted for perf_report.
+// the threads that program_check starts call this before they finish, since every round of --watch starts new ones
+void perf_thread_close(void)
+{
+	PerfThread *t = perf_thread;
+	if (t == NULL)
 	{
-		lexer_set_token(lexer, token_create(TOK_END_OF_FILE, "EOF"));
 		return;
 	}
-
-	if (is_digit(lexer_char(lexer)))
+	perf_thread = NULL;
+	if (t->group_fd < 0)
 	{
-		while (lexer_has_more_chars(lexer) && is_digit(lexer_char(lexer)))
-		{
-			lexer->pos++;
-		}
-
-		char *text = substr(lexer->source, start, lexer->pos);
-		lexer_set_token(lexer, token_create(TOK_NUMBER, text));
+		// it never made it into perf_threads
+		free(t);
 		return;
 	}
 
-	if (is_alpha(lexer_char(lexer)))
+	perf_thread_charge(t);
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++)
 	{
-		while (lexer_has_more_chars(lexer) && is_identifier_char(lexer_char(lexer)))
+		if (t->fds[i] >= 0)
 		{
-			lexer->pos++;
+			close(t->fds[i]);
 		}
+	}
 
-		char *text = substr(lexer->source, start, lexer->pos);
-		TokenKind kind;
-		if (STRNCMP(text, "function"))
+	pthread_mutex_lock(&perf_lock);
+	PerfThread **link = &perf_threads;
+	while (*link != t)
+	{
+		link = &(*link)->next;
+	}
+	*link = t->next;
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+	{
+		perf_finished_available[i] |= t->slot[i] >= 0;
+		for (int phase = 0; phase < PERF_PHASE_COUNT; phase++)
 		{
-			kind = TOK_FUNCTION;
+			perf_finished_totals[phase][i] += t->totals[phase][i];
 		}
-		else if (STRNCMP(text, "let"))
+	}
+	pthread_mutex_unlock(&perf_lock);
+	free(t);
+}
+
+// turns the counters on for the calling thread. returns false and leaves them off if the kernel doesn't allow them
+bool perf_start(void)
+{
+	perf_enabled = true;
+	if (perf_current_thread() == NULL)
+	{
+		perf_enabled = false;
+		return false;
+	}
+	return true;
+}
+
+void perf_report(FILE *f)
+{
+	perf_flush();
+
+	uint64_t totals[PERF_PHASE_COUNT + 1][PERF_COUNTER_COUNT] = { { 0 } };
+	bool available[PERF_COUNTER_COUNT] = { false };
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+	{
+		available[i] = perf_finished_available[i];
+		for (int phase = 0; phase < PERF_PHASE_COUNT; phase++)
 		{
-			kind = TOK_LET;
+			totals[phase][i] = perf_finished_totals[phase][i];
+			totals[PERF_PHASE_COUNT][i] += perf_finished_totals[phase][i];
 		}
-		else if (STRNCMP(text, "kind"))
+	}
+	for (PerfThread *t = perf_threads; t != NULL; t = t->next)
+	{
+		for (int i = 0; i < PERF_COUNTER_COUNT; i++)
 		{
-			kind = TOK_TYPE;
+			available[i] |= t->slot[i] >= 0;
+			for (int phase = 0; phase < PERF_PHASE_COUNT; phase++)
+			{
+				totals[phase][i] += t->totals[phase][i];
+				totals[PERF_PHASE_COUNT][i] += t->totals[phase][i];
+			}
 		}
-		else if (STRNCMP(text, "return"))
+	}
+
+	fprintf(f, "%-8s", "phase");
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+	{
+		fprintf(f, " %15s", perf_counter_names[i]);
+	}
+	fprintf(f, " %6s\n", "IPC");
+	for (int phase = 0; phase <= PERF_PHASE_COUNT; phase++)
+	{
+		fprintf(f, "%-8s", phase == PERF_PHASE_COUNT ? "total" : perf_phase_names[phase]);
+		for (int i = 0; i < PERF_COUNTER_COUNT; i++)
 		{
-			kind = TOK_RETURN;
+			if (available[i])
+			{
+				fprintf(f, " %15" PRIu64, totals[phase][i]);
+			}
+			else
+			{
+				fprintf(f, " %15s", "-");
+			}
 		}
-		else if ((STRNCMP(text, "true") || STRNCMP(text, "false")))
+		uint64_t cycles = totals[phase][PERF_CYCLES];
+		if (available[PERF_CYCLES] && available[PERF_INSTRUCTIONS] && cycles > 0)
 		{
-			kind = TOK_BOOL;
+			fprintf(f, " %6.2f\n", (double)totals[phase][PERF_INSTRUCTIONS] / cycles);
 		}
 		else
 		{
-			kind = TOK_IDENT;
+			fprintf(f, " %6s\n", "-");
 		}
-		lexer_set_token(lexer, token_create(kind, text));
-		return;
-	}
-
-	lexer->pos++;
-	switch (lexer->source[lexer->pos - 1])
-	{
-	case '=':
-		lexer_set_token(lexer, token_create(TOK_EQ, "="));
-		break;
-	case ';':
-		lexer_set_token(lexer, token_create(TOK_SEMICOLON, ";"));
-		break;
-	case ':':
-		lexer_set_token(lexer, token_create(TOK_COLON, ":"));
-		break;
-	default:
-	{
-		char *text = substr(lexer->source, start, lexer->pos);
-		lexer_set_token(lexer, token_create(TOK_UNKNOWN, text));
-		break;
-	}
 	}
 }
 
+// a span of the --trace timeline. names are string literals and files are paths owned by the program, so recording an
+// event copies no strings
 typedef struct
 {
-	size_t pos;
-} Location;
+	const char *name;
+	const char *file;
+	uint64_t start;
+	uint64_t end;
+	// -1 if unknown
+	int64_t bytes;
+	const char *result;
+} TraceEvent;
+
+typedef struct TraceBuffer_ TraceBuffer;
+
+// the events of one thread. only that thread appends to it, so recording takes no lock
+struct TraceBuffer_
+{
+	int tid;
+	TraceEvent *events;
+	TraceBuffer *next;
+};
 
-typedef struct
+bool trace_enabled = false;
+TraceBuffer *trace_buffers = NULL;
+int trace_thread_count = 0;
+_Thread_local TraceBuffer *trace_buffer = NULL;
+
+uint64_t trace_clock(void)
 {
-	int id;
-} Type;
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 
-const Type TYPE_NUMBER = (Type){ .id = 0 };
-const Type TYPE_BOOL = (Type){ .id = 1 };
+// returns the start time of a span, or 0 if tracing is off
+uint64_t trace_begin(void)
+{
+	return trace_enabled ? trace_clock() : 0;
+}
 
-typedef enum
+TraceBuffer *trace_current_buffer(void)
 {
-	EXPR_IDENT,
-	EXPR_NUM,
-	EXPR_BOOL,
-	EXPR_ASSIGNMENT,
-} ExprKind;
+	if (trace_buffer == NULL)
+	{
+		TraceBuffer *buffer = calloc(1, sizeof(TraceBuffer));
+		buffer->tid = __atomic_add_fetch(&trace_thread_count, 1, __ATOMIC_RELAXED);
+		buffer->next = __atomic_load_n(&trace_buffers, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&trace_buffers, &buffer->next, buffer, true, __ATOMIC_RELEASE,
+			__ATOMIC_RELAXED))
+		{
+		}
+		trace_buffer = buffer;
+	}
+	return trace_buffer;
+}
 
-typedef struct
+void trace_end_file(const char *name, const char *file, uint64_t start, int64_t bytes, const char *result)
 {
-	const char *text;
-} Ident;
+	if (!trace_enabled)
+	{
+		return;
+	}
+	TraceEvent event = {
+		.name = name,
+		.file = file,
+		.start = start,
+		.end = trace_clock(),
+		.bytes = bytes,
+		.result = result,
+	};
+	sbpush(trace_current_buffer()->events, event);
+}
 
-typedef struct
+void trace_end(const char *name, uint64_t start)
 {
-	double value;
-} Number;
+	trace_end_file(name, NULL, start, -1, NULL);
+}
 
-typedef struct Expr_ Expr;
+uint64_t trace_epoch;
 
-typedef struct
+void trace_enable(void)
 {
-	Ident name;
-	Expr *expr;
-} Assignment;
+	trace_enabled = true;
+	trace_epoch = trace_clock();
+	// the calling thread gets the first thread ID
+	trace_current_buffer();
+}
 
-struct Expr_
+// writes `s` escaped for the inside of a JSON string
+void trace_write_escaped(FILE *f, const char *s)
 {
-	ExprKind kind;
-	Location location;
-
-	union
+	for (; *s != '\0'; s++)
 	{
-		// EXPR_IDENT
-		Ident ident;
-		// EXPR_NUM
-		Number num;
-		// EXPR_BOOL
-		bool boolean;
-		// EXPR_ASSIGNMENT
-		Assignment assignment;
-	};
-};
+		if (*s == '"' || *s == '\\')
+		{
+			fprintf(f, "\\%c", *s);
+		}
+		else if ((unsigned char)*s < 0x20)
+		{
+			fprintf(f, "\\u%04x", *s);
+		}
+		else
+		{
+			fputc(*s, f);
+		}
+	}
+}
 
-Expr expr_ident_create(Location location, const char *text)
+// writes every recorded span as a Chrome trace event file. must only be called once the threads that recorded them have
+// finished
+bool trace_write(const char *path)
 {
-	Expr expr;
-	expr.kind = EXPR_IDENT;
-	expr.location = location;
-	Ident ident = { .text = text };
-	expr.ident = ident;
-	return expr;
+	FILE *f = fopen(path, "w");
+	if (f == NULL)
+	{
+		return false;
+	}
+
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+	for (TraceBuffer *buffer = trace_buffers; buffer != NULL; buffer = buffer->next)
+	{
+		fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+			first ? "" : ",\n", buffer->tid, buffer->tid == 1 ? "main" : "worker", buffer->tid);
+		first = false;
+
+		for (size_t i = 0; i < sbcount(buffer->events); i++)
+		{
+			TraceEvent *event = &buffer->events[i];
+			// timestamps are in microseconds, printed from the nanoseconds without going through floating point
+			uint64_t ts = event->start - trace_epoch;
+			uint64_t dur = event->end - event->start;
+			fprintf(f,
+				",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%" PRIu64 ".%03u,\"dur\":%" PRIu64 ".%03u,\"name\":",
+				buffer->tid, ts / 1000, (unsigned)(ts % 1000), dur / 1000, (unsigned)(dur % 1000));
+			// spans of a file are labelled with it, so that stragglers can be told apart at a glance
+			fprintf(f, "\"%s", event->name);
+			if (event->file != NULL)
+			{
+				fputc(' ', f);
+				trace_write_escaped(f, event->file);
+			}
+			fprintf(f, "\",\"cat\":\"%s\",\"args\":{", event->name);
+			bool first_arg = true;
+			if (event->file != NULL)
+			{
+				fprintf(f, "\"file\":\"");
+				trace_write_escaped(f, event->file);
+				fputc('"', f);
+				first_arg = false;
+			}
+			if (event->bytes >= 0)
+			{
+				fprintf(f, "%s\"bytes\":%" PRId64, first_arg ? "" : ",", event->bytes);
+				first_arg = false;
+			}
+			if (event->result != NULL)
+			{
+				fprintf(f, "%s\"result\":\"%s\"", first_arg ? "" : ",", event->result);
+			}
+			fprintf(f, "}}");
+		}
+	}
+	fprintf(f, "\n]}\n");
+
+	return fclose(f) == 0;
 }
 
-Expr expr_num_create(Location location, double value)
+uint64_t hash_string(const char *s)
 {
-	Expr expr;
-	expr.kind = EXPR_NUM;
-	expr.location = location;
-	Number num = { .value = value };
-	expr.num = num;
-	return expr;
+	// FNV-1a
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (; *s != '\0'; s++)
+	{
+		hash ^= (unsigned char)*s;
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
 }
 
-Expr expr_assignment_create(Location location, Ident name, Expr *value)
+uint64_t hash_combine(uint64_t hash, uint64_t value)
 {
-	Assignment assignment = { .expr = value, .name = name };
-	Expr expr = {
-		.kind = EXPR_ASSIGNMENT,
-		.location = location,
-		.assignment = assignment,
-	};
-	return expr;
+	hash ^= value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+	return hash;
 }
 
-Expr expr_bool_create(Location location, bool value)
+// a fast 64-bit hash over 8 bytes at a time, used for source contents
+uint64_t hash_bytes(const void *data, size_t len)
 {
-	Expr expr = {
-		.kind = EXPR_BOOL,
-		.location = location,
-		.boolean = value,
-	};
-	return expr;
+	const unsigned char *p = data;
+	uint64_t hash = 0x9e3779b97f4a7c15ull ^ len;
+	for (; len >= 8; p += 8, len -= 8)
+	{
+		uint64_t word;
+		memcpy(&word, p, sizeof(word));
+		hash = ((hash << 5 | hash >> 59) ^ word) * 0x51afd7ed558ccd1bull;
+	}
+
+	uint64_t tail = 0;
+	memcpy(&tail, p, len);
+	hash = ((hash << 5 | hash >> 59) ^ tail) * 0x51afd7ed558ccd1bull;
+
+	// murmur3's finalizer
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdull;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ull;
+	hash ^= hash >> 33;
+	return hash;
 }
 
-typedef struct Scope_ Scope;
+// identifiers are interned into symbols, which are shared by every thread and every module: comparing two names is
+// comparing two integers, and the text of each distinct name is stored once. the interner is split into shards by hash,
+// each with its own lock, hash table and arena. looking up a name that is already interned takes no lock at all, which
+// is by far the common case
+typedef uint32_t Symbol;
 
-typedef enum
-{
-	DECL_LET,
-	DECL_TYPE_ALIAS,
-} DeclKind;
+#define INTERN_SHARD_BITS 6
+#define INTERN_SHARDS (1 << INTERN_SHARD_BITS)
+// the records of a shard live in fixed size chunks that never move, so that readers can index them without a lock
+#define INTERN_CHUNK_BITS 12
+#define INTERN_CHUNK_SIZE (1 << INTERN_CHUNK_BITS)
+#define INTERN_MAX_CHUNKS (1 << (32 - INTERN_SHARD_BITS - INTERN_CHUNK_BITS))
+#define INTERN_ARENA_SIZE (64 * 1024)
 
 typedef struct
 {
-	Ident name;
-	Ident *type_name;
-	Expr init;
-} Let;
+	const char *text;
+	size_t len;
+	uint64_t hash;
+} InternRecord;
 
+// open addressing, each slot holds a local symbol index + 1, or 0 if it is empty
 typedef struct
 {
-	Ident name;
-	Ident type_name;
-} TypeAlias;
+	size_t mask;
+	uint32_t slots[];
+} InternTable;
 
 typedef struct
 {
-	DeclKind kind;
-	Location location;
-
-	union
+	pthread_mutex_t lock;
+	// replaced by a copy twice its size when it is half full. a reader may still be probing the old one, so tables are
+	// never freed: a reader that misses in an old table takes the lock and looks again
+	InternTable *table;
+	uint32_t count;
+	InternRecord *chunks[INTERN_MAX_CHUNKS];
+	char *arena;
+	size_t arena_left;
+} InternShard;
+
+InternShard intern_shards[INTERN_SHARDS];
+pthread_once_t intern_once = PTHREAD_ONCE_INIT;
+
+void intern_init(void)
+{
+	for (size_t i = 0; i < INTERN_SHARDS; i++)
 	{
-		// DECL_LET
-		Let let;
-		// DECL_TYPE_ALIAS
-		TypeAlias type_alias;
-	};
-} Decl;
-
-bool expr_infer_type(Expr expr, Scope *scope, Type *ty);
+		InternShard *shard = &intern_shards[i];
+		pthread_mutex_init(&shard->lock, NULL);
+		shard->table = calloc(1, sizeof(InternTable) + 64 * sizeof(uint32_t));
+		shard->table->mask = 63;
+	}
+}
 
-Decl decl_let_create(Location location, Ident name, Ident *type_name, Expr init)
+InternRecord *intern_record(InternShard *shard, uint32_t index)
 {
-	Decl decl;
-	decl.kind = DECL_LET;
-	decl.location = location;
-
-	Let let = { .name = name, .type_name = type_name, .init = init };
-	decl.let = let;
+	return &shard->chunks[index >> INTERN_CHUNK_BITS][index & (INTERN_CHUNK_SIZE - 1)];
+}
 
-	return decl;
+// returns the slot that holds `text`, or the empty slot where it belongs
+uint32_t *intern_probe(InternShard *shard, InternTable *table, const char *text, size_t len, uint64_t hash)
+{
+	for (size_t i = (hash >> INTERN_SHARD_BITS) & table->mask;; i = (i + 1) & table->mask)
+	{
+		uint32_t slot = __atomic_load_n(&table->slots[i], __ATOMIC_ACQUIRE);
+		if (slot == 0)
+		{
+			return &table->slots[i];
+		}
+		InternRecord *record = intern_record(shard, slot - 1);
+		if (record->hash == hash && record->len == len && memcmp(record->text, text, len) == 0)
+		{
+			return &table->slots[i];
+		}
+	}
 }
 
-Decl decl_type_alias_create(Location location, Ident name, Ident type_name)
+void intern_grow(InternShard *shard)
 {
-	Decl decl;
-	decl.kind = DECL_TYPE_ALIAS;
-	decl.location = location;
-	TypeAlias type_alias = { .name = name, .type_name = type_name };
-	decl.type_alias = type_alias;
-	return decl;
+	InternTable *old = shard->table;
+	size_t cap = (old->mask + 1) * 2;
+	InternTable *table = calloc(1, sizeof(InternTable) + cap * sizeof(uint32_t));
+	if (table == NULL)
+	{
+		fprintf(stderr, "out of memory: could not grow the symbol table to %zu entries\n", cap);
+		exit(1);
+	}
+	table->mask = cap - 1;
+	for (uint32_t i = 0; i < shard->count; i++)
+	{
+		InternRecord *record = intern_record(shard, i);
+		*intern_probe(shard, table, record->text, record->len, record->hash) = i + 1;
+	}
+	__atomic_store_n(&shard->table, table, __ATOMIC_RELEASE);
 }
 
-typedef enum
+// copies the text into the shard's arena, NUL terminated so that it can be printed
+const char *intern_copy(InternShard *shard, const char *text, size_t len)
 {
-	STMT_EXPR,
-	STMT_DECL,
-} StmtKind;
+	char *copy;
+	if (len + 1 > INTERN_ARENA_SIZE / 4)
+	{
+		copy = malloc(len + 1);
+	}
+	else
+	{
+		if (len + 1 > shard->arena_left)
+		{
+			shard->arena = malloc(INTERN_ARENA_SIZE);
+			shard->arena_left = INTERN_ARENA_SIZE;
+		}
+		copy = shard->arena;
+		shard->arena += len + 1;
+		shard->arena_left -= len + 1;
+	}
+	if (copy == NULL)
+	{
+		fprintf(stderr, "out of memory: could not intern a name of %zu bytes\n", len);
+		exit(1);
+	}
+	memcpy(copy, text, len);
+	copy[len] = '\0';
+	return copy;
+}
 
-typedef struct
+// symbols are numbered per shard, and the shard is kept in the low bits of the symbol
+Symbol intern(const char *text, size_t len)
 {
-	StmtKind kind;
-	Location location;
+	pthread_once(&intern_once, intern_init);
+	uint64_t hash = hash_bytes(text, len);
+	size_t shard_index = hash & (INTERN_SHARDS - 1);
+	InternShard *shard = &intern_shards[shard_index];
+
+	InternTable *table = __atomic_load_n(&shard->table, __ATOMIC_ACQUIRE);
+	uint32_t slot = __atomic_load_n(intern_probe(shard, table, text, len, hash), __ATOMIC_ACQUIRE);
+	if (slot != 0)
+	{
+		return (slot - 1) << INTERN_SHARD_BITS | shard_index;
+	}
 
-	union
+	pthread_mutex_lock(&shard->lock);
+	uint32_t *found = intern_probe(shard, shard->table, text, len, hash);
+	slot = *found;
+	if (slot == 0)
 	{
-		// STMT_EXPR
-		Expr expr;
-		// STMT_DECL
-		Decl decl;
-	};
-} Stmt;
+		uint32_t index = shard->count;
+		if ((index >> INTERN_CHUNK_BITS) >= INTERN_MAX_CHUNKS)
+		{
+			// names are spread over the shards by hash, so this is hit when any one shard is full
+			fprintf(stderr, "too many distinct names, at most %d can be interned per shard\n",
+				INTERN_MAX_CHUNKS * INTERN_CHUNK_SIZE);
+			exit(1);
+		}
+		if ((index & (INTERN_CHUNK_SIZE - 1)) == 0)
+		{
+			shard->chunks[index >> INTERN_CHUNK_BITS] = malloc(INTERN_CHUNK_SIZE * sizeof(InternRecord));
+			if (shard->chunks[index >> INTERN_CHUNK_BITS] == NULL)
+			{
+				fprintf(stderr, "out of memory: could not grow the symbol table\n");
+				exit(1);
+			}
+		}
+		*intern_record(shard, index) = (InternRecord){ .text = intern_copy(shard, text, len), .len = len, .hash = hash };
+		shard->count++;
+		// the record is complete before the slot that leads to it is published
+		slot = index + 1;
+		__atomic_store_n(found, slot, __ATOMIC_RELEASE);
+		if ((size_t)shard->count * 2 > shard->table->mask + 1)
+		{
+			intern_grow(shard);
+		}
+	}
+	pthread_mutex_unlock(&shard->lock);
+	return (slot - 1) << INTERN_SHARD_BITS | shard_index;
+}
 
-Stmt stmt_expr_create(Location location, Expr expr)
+Symbol intern_string(const char *text)
 {
-	Stmt stmt;
-	stmt.kind = STMT_EXPR;
-	stmt.location = location;
-	stmt.expr = expr;
-	return stmt;
+	return intern(text, strlen(text));
 }
 
-Stmt stmt_decl_create(Location location, Decl decl)
+const char *symbol_text(Symbol sym)
 {
-	Stmt stmt;
-	stmt.kind = STMT_DECL;
-	stmt.location = location;
-	stmt.decl = decl;
-	return stmt;
+	return intern_record(&intern_shards[sym & (INTERN_SHARDS - 1)], sym >> INTERN_SHARD_BITS)->text;
 }
 
-#define UNREACHABLE(...)                                                                                               \
-    do                                                                                                                 \
-    {                                                                                                                  \
-        fprintf(stderr, "unreachable: " __VA_ARGS__);                                                                  \
-        exit(1);                                                                                                       \
-    } while (0)
+size_t symbol_len(Symbol sym)
+{
+	return intern_record(&intern_shards[sym & (INTERN_SHARDS - 1)], sym >> INTERN_SHARD_BITS)->len;
+}
 
-typedef struct
+typedef enum
 {
-	bool in_use;
-	const char *key;
-	Decl val;
-} HashmapEntry;
+	TOK_FUNCTION,
+	TOK_LET,
+	TOK_TYPE,
+	TOK_RETURN,
+	TOK_IMPORT,
+	TOK_EXPORT,
+	TOK_EQ,
+	TOK_NUMBER,
+	TOK_BOOL,
+	TOK_IDENT,
+	TOK_SEMICOLON,
+	TOK_COLON,
+	TOK_COMMA,
+	TOK_LBRACE,
+	TOK_RBRACE,
+	TOK_LPAREN,
+	TOK_RPAREN,
+	TOK_STRING,
+	TOK_END_OF_FILE,
+	TOK_UNKNOWN,
+} TokenKind;
+
+char *token_kind_name(TokenKind kind)
+{
+	switch (kind)
+	{
+	case TOK_FUNCTION:
+		return "TOK_FUNCTION";
+	case TOK_LET:
+		return "TOK_LET";
+	case TOK_TYPE:
+		return "TOK_TYPE";
+	case TOK_RETURN:
+		return "TOK_RETURN";
+	case TOK_IMPORT:
+		return "TOK_IMPORT";
+	case TOK_EXPORT:
+		return "TOK_EXPORT";
+	case TOK_EQ:
+		return "TOK_EQ";
+	case TOK_NUMBER:
+		return "TOK_NUMBER";
+	case TOK_BOOL:
+		return "TOK_BOOL";
+	case TOK_IDENT:
+		return "TOK_IDENT";
+	case TOK_SEMICOLON:
+		return "TOK_SEMICOLON";
+	case TOK_COLON:
+		return "TOK_COLON";
+	case TOK_COMMA:
+		return "TOK_COMMA";
+	case TOK_LBRACE:
+		return "TOK_LBRACE";
+	case TOK_RBRACE:
+		return "TOK_RBRACE";
+	case TOK_LPAREN:
+		return "TOK_LPAREN";
+	case TOK_RPAREN:
+		return "TOK_RPAREN";
+	case TOK_STRING:
+		return "TOK_STRING";
+	case TOK_END_OF_FILE:
+		return "TOK_END_OF_FILE";
+	case TOK_UNKNOWN:
+		return "TOK_UNKNOWN";
+	default:
+		return "(unknown token kind)";
+	}
+}
 
 typedef struct
 {
-	int cap;
-	int size;
-	HashmapEntry *entries;
-} Hashmap;
+	TokenKind kind;
+	char *text;
+	// TOK_IDENT: the interned identifier, whose text is the token's text
+	Symbol sym;
+	// whether the text is freed along with the token. identifiers are interned and string texts end up in the AST, so
+	// neither ever is
+	bool owns_text;
+} Token;
 
-void hm_init(Hashmap *hm)
+Token *token_create(TokenKind kind, char *text)
 {
-	hm->cap = 2;
-	hm->size = 0;
-	hm->entries = calloc(hm->cap, sizeof(HashmapEntry));
+	Token *token = malloc(sizeof(Token));
+	token->kind = kind;
+	token->text = text;
+	token->sym = 0;
+	token->owns_text = false;
+	return token;
 }
 
-void hm_ensure(Hashmap *hm, int min_cap)
+Token *token_create_owning(TokenKind kind, char *text)
 {
-	if (hm->cap >= min_cap)
-	{
-		return;
+	Token *token = token_create(kind, text);
+	token->owns_text = true;
+	return token;
+}
+
+typedef struct
+{
+	Token *prev_token;
+	Token *token;
+	size_t pos;
+	const char *source;
+	size_t source_len;
+	// every byte in [pos, ascii_end) is known to be < 0x80, so it can be classified without decoding UTF-8
+	size_t ascii_end;
+	// set if the source is a private mapping of a file, whose pages can be dropped once they have been lexed
+	bool source_mapped;
+	size_t released;
+} Lexer;
+
+Lexer *lexer_create(const char *source, size_t source_len)
+{
+	Lexer *lexer = malloc(sizeof(Lexer));
+	lexer->token = NULL;
+	lexer->prev_token = NULL;
+	lexer->pos = 0;
+	lexer->source = source;
+	lexer->source_len = source_len;
+	lexer->ascii_end = 0;
+	lexer->source_mapped = false;
+	lexer->released = 0;
+	return lexer;
+}
+
+#define LEXER_RELEASE_CHUNK (1 << 20)
+
+// drops the pages of a mapped source before the current position. reading them again, e.g. to print the line of an
+// error, simply faults them back in from the file
+void lexer_release_consumed(Lexer *lexer)
+{
+	if (!lexer->source_mapped)
+	{
+		return;
+	}
+
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t end = lexer->pos & ~(page_size - 1);
+	if (end >= lexer->released + LEXER_RELEASE_CHUNK)
+	{
+		madvise((char *)lexer->source + lexer->released, end - lexer->released, MADV_DONTNEED);
+		lexer->released = end;
+	}
+}
+
+bool lexer_has_more_chars(Lexer *lexer)
+{
+	return lexer->pos < lexer->source_len;
+}
+
+char lexer_char(Lexer *lexer)
+{
+	return lexer->source[lexer->pos];
+}
+
+char *substr(const char *orig, size_t from, size_t to)
+{
+	size_t len = to - from;
+	char *sub = calloc(len + 1, sizeof(char));
+	strncpy(sub, orig + from, len);
+	sub[len] = '\0';
+	return sub;
+}
+
+bool is_digit(char c)
+{
+	return '0' <= c && c <= '9';
+}
+
+bool is_alpha(char c)
+{
+	return ('A' <= c && c <= 'Z') || ('a' <= c && c <= 'z');
+}
+
+bool is_alphanumeric(char c)
+{
+	return is_alpha(c) || is_digit(c);
+}
+
+bool is_identifier_char(char c)
+{
+	return is_alphanumeric(c) || c == '_';
+}
+
+bool is_ascii(char c)
+{
+	return (unsigned char)c < 0x80;
+}
+
+// returns the length of the longest prefix of `s` that only contains ASCII bytes
+size_t ascii_prefix_len(const char *s, size_t len)
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	for (; i + 16 <= len; i += 16)
+	{
+		int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(s + i)));
+		if (mask != 0)
+		{
+			return i + __builtin_ctz(mask);
+		}
+	}
+#else
+	for (; i + 8 <= len; i += 8)
+	{
+		uint64_t word;
+		memcpy(&word, s + i, sizeof(word));
+		if ((word & 0x8080808080808080ull) != 0)
+		{
+			break;
+		}
+	}
+#endif
+	while (i < len && is_ascii(s[i]))
+	{
+		i++;
+	}
+	return i;
+}
+
+// decodes the UTF-8 sequence at the start of `s` into `cp`. returns the length of the sequence, or 0 if it is not valid
+// UTF-8 (truncated, overlong, a surrogate, or out of range)
+size_t utf8_decode(const char *s, size_t len, uint32_t *cp)
+{
+	const unsigned char *u = (const unsigned char *)s;
+	if (len == 0)
+	{
+		return 0;
+	}
+
+	size_t n;
+	uint32_t min;
+	if (u[0] < 0x80)
+	{
+		*cp = u[0];
+		return 1;
+	}
+	else if ((u[0] & 0xE0) == 0xC0)
+	{
+		n = 2;
+		min = 0x80;
+		*cp = u[0] & 0x1F;
+	}
+	else if ((u[0] & 0xF0) == 0xE0)
+	{
+		n = 3;
+		min = 0x800;
+		*cp = u[0] & 0x0F;
+	}
+	else if ((u[0] & 0xF8) == 0xF0)
+	{
+		n = 4;
+		min = 0x10000;
+		*cp = u[0] & 0x07;
+	}
+	else
+	{
+		return 0;
+	}
+
+	if (len < n)
+	{
+		return 0;
+	}
+	for (size_t i = 1; i < n; i++)
+	{
+		if ((u[i] & 0xC0) != 0x80)
+		{
+			return 0;
+		}
+		*cp = (*cp << 6) | (u[i] & 0x3F);
+	}
+
+	if (*cp < min || *cp > 0x10FFFF || (0xD800 <= *cp && *cp <= 0xDFFF))
+	{
+		return 0;
+	}
+	return n;
+}
+
+bool unicode_ranges_contain(const uint32_t ranges[][2], size_t count, uint32_t cp)
+{
+	size_t lo = 0;
+	size_t hi = count;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if (cp < ranges[mid][0])
+		{
+			hi = mid;
+		}
+		else if (cp > ranges[mid][1])
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+#define COUNT_OF(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+// only called for non-ASCII code points, ASCII goes through is_alpha and is_identifier_char
+bool unicode_is_id_start(uint32_t cp)
+{
+	return unicode_ranges_contain(unicode_id_start_ranges, COUNT_OF(unicode_id_start_ranges), cp);
+}
+
+bool unicode_is_id_continue(uint32_t cp)
+{
+	return unicode_ranges_contain(unicode_id_continue_ranges, COUNT_OF(unicode_id_continue_ranges), cp);
+}
+
+void lexer_set_token(Lexer *lexer, Token *token);
+
+// moves the lexer to `pos`, forgetting the tokens it has seen
+void lexer_seek(Lexer *lexer, size_t pos)
+{
+	lexer_set_token(lexer, NULL);
+	lexer_set_token(lexer, NULL);
+	lexer->pos = pos;
+	lexer->ascii_end = pos;
+}
+
+void lexer_set_token(Lexer *lexer, Token *token)
+{
+	if (lexer->prev_token != NULL)
+	{
+		if (lexer->prev_token->owns_text)
+		{
+			free(lexer->prev_token->text);
+		}
+		free(lexer->prev_token);
+	}
+	lexer->prev_token = lexer->token;
+	lexer->token = token;
+}
+
+#define STRNCMP(s1, s2) (strncmp(s1, s2, sizeof(s2) - 1) == 0)
+#define KEYWORD_EQ(text, len, keyword) ((len) == sizeof(keyword) - 1 && memcmp(text, keyword, len) == 0)
+
+// returns the length of the non-ASCII identifier character at the lexer position, or 0 if there isn't one
+size_t lexer_unicode_identifier_char_len(Lexer *lexer, bool start)
+{
+	uint32_t cp;
+	size_t n = utf8_decode(lexer->source + lexer->pos, lexer->source_len - lexer->pos, &cp);
+	if (n == 0)
+	{
+		return 0;
+	}
+	bool ok = start ? unicode_is_id_start(cp) : unicode_is_id_continue(cp);
+	return ok ? n : 0;
+}
+
+#define ASCII_SCAN_WINDOW 4096
+
+void lexer_skip_identifier_chars(Lexer *lexer)
+{
+	while (lexer_has_more_chars(lexer))
+	{
+		if (lexer->pos >= lexer->ascii_end)
+		{
+			// the scan is bounded so that it never runs far ahead of the lexer over a huge ASCII source
+			size_t rest = lexer->source_len - lexer->pos;
+			lexer->ascii_end = lexer->pos + ascii_prefix_len(lexer->source + lexer->pos,
+				rest < ASCII_SCAN_WINDOW ? rest : ASCII_SCAN_WINDOW);
+		}
+
+		if (lexer->pos < lexer->ascii_end)
+		{
+			// fast path, no decoding needed until the end of the ASCII run
+			while (lexer->pos < lexer->ascii_end && is_identifier_char(lexer_char(lexer)))
+			{
+				lexer->pos++;
+			}
+			if (lexer->pos < lexer->ascii_end)
+			{
+				return;
+			}
+			continue;
+		}
+
+		size_t n = lexer_unicode_identifier_char_len(lexer, false);
+		if (n == 0)
+		{
+			return;
+		}
+		lexer->pos += n;
+	}
+}
+
+TokenKind keyword_kind(const char *text, size_t len)
+{
+	if (KEYWORD_EQ(text, len, "function"))
+	{
+		return TOK_FUNCTION;
+	}
+	else if (KEYWORD_EQ(text, len, "let"))
+	{
+		return TOK_LET;
+	}
+	else if (KEYWORD_EQ(text, len, "type"))
+	{
+		return TOK_TYPE;
+	}
+	else if (KEYWORD_EQ(text, len, "return"))
+	{
+		return TOK_RETURN;
+	}
+	else if (KEYWORD_EQ(text, len, "import"))
+	{
+		return TOK_IMPORT;
+	}
+	else if (KEYWORD_EQ(text, len, "export"))
+	{
+		return TOK_EXPORT;
+	}
+	else if (KEYWORD_EQ(text, len, "true") || KEYWORD_EQ(text, len, "false"))
+	{
+		return TOK_BOOL;
+	}
+	else
+	{
+		return TOK_IDENT;
+	}
+}
+
+void lexer_scan_token(Lexer *lexer)
+{
+	if (lexer->token != NULL && lexer->token->kind == TOK_END_OF_FILE)
+	{
+		return;
+	}
+
+	while (lexer_has_more_chars(lexer) && isspace(lexer_char(lexer)))
+	{
+		lexer->pos++;
+	}
+
+	size_t start = lexer->pos;
+	if (!lexer_has_more_chars(lexer))
+	{
+		lexer_set_token(lexer, token_create(TOK_END_OF_FILE, "EOF"));
+		return;
+	}
+
+	if (is_digit(lexer_char(lexer)))
+	{
+		while (lexer_has_more_chars(lexer) && is_digit(lexer_char(lexer)))
+		{
+			lexer->pos++;
+		}
+
+		char *text = substr(lexer->source, start, lexer->pos);
+		lexer_set_token(lexer, token_create_owning(TOK_NUMBER, text));
+		return;
+	}
+
+	size_t unicode_start_len = 0;
+	if (is_alpha(lexer_char(lexer)) ||
+		(!is_ascii(lexer_char(lexer)) && (unicode_start_len = lexer_unicode_identifier_char_len(lexer, true)) > 0))
+	{
+		lexer->pos += unicode_start_len > 0 ? unicode_start_len : 1;
+		lexer_skip_identifier_chars(lexer);
+
+		// identifiers are interned straight from the source, which copies each distinct name only once
+		TokenKind kind = keyword_kind(lexer->source + start, lexer->pos - start);
+		if (kind == TOK_IDENT)
+		{
+			Symbol sym = intern(lexer->source + start, lexer->pos - start);
+			Token *token = token_create(kind, (char *)symbol_text(sym));
+			token->sym = sym;
+			lexer_set_token(lexer, token);
+		}
+		else
+		{
+			lexer_set_token(lexer, token_create_owning(kind, substr(lexer->source, start, lexer->pos)));
+		}
+		return;
+	}
+
+	if (!is_ascii(lexer_char(lexer)))
+	{
+		// keep a whole code point in the token so that it can be printed
+		uint32_t cp;
+		size_t n = utf8_decode(lexer->source + lexer->pos, lexer->source_len - lexer->pos, &cp);
+		lexer->pos += n > 0 ? n : 1;
+		char *text = substr(lexer->source, start, lexer->pos);
+		lexer_set_token(lexer, token_create_owning(TOK_UNKNOWN, text));
+		return;
+	}
+
+	lexer->pos++;
+	switch (lexer->source[lexer->pos - 1])
+	{
+	case '=':
+		lexer_set_token(lexer, token_create(TOK_EQ, "="));
+		break;
+	case ';':
+		lexer_set_token(lexer, token_create(TOK_SEMICOLON, ";"));
+		break;
+	case ':':
+		lexer_set_token(lexer, token_create(TOK_COLON, ":"));
+		break;
+	case ',':
+		lexer_set_token(lexer, token_create(TOK_COMMA, ","));
+		break;
+	case '{':
+		lexer_set_token(lexer, token_create(TOK_LBRACE, "{"));
+		break;
+	case '}':
+		lexer_set_token(lexer, token_create(TOK_RBRACE, "}"));
+		break;
+	case '(':
+		lexer_set_token(lexer, token_create(TOK_LPAREN, "("));
+		break;
+	case ')':
+		lexer_set_token(lexer, token_create(TOK_RPAREN, ")"));
+		break;
+	case '"':
+	case '\'':
+	{
+		// string literals only appear as module specifiers, so there are no escape sequences
+		char quote = lexer->source[start];
+		while (lexer_has_more_chars(lexer) && lexer_char(lexer) != quote && lexer_char(lexer) != '\n')
+		{
+			lexer->pos++;
+		}
+		if (!lexer_has_more_chars(lexer) || lexer_char(lexer) != quote)
+		{
+			char *text = substr(lexer->source, start, lexer->pos);
+			lexer_set_token(lexer, token_create_owning(TOK_UNKNOWN, text));
+			break;
+		}
+		char *text = substr(lexer->source, start + 1, lexer->pos);
+		lexer->pos++;
+		lexer_set_token(lexer, token_create(TOK_STRING, text));
+		break;
+	}
+	default:
+	{
+		char *text = substr(lexer->source, start, lexer->pos);
+		lexer_set_token(lexer, token_create_owning(TOK_UNKNOWN, text));
+		break;
+	}
+	}
+}
+
+typedef struct
+{
+	size_t pos;
+} Location;
+
+typedef struct
+{
+	int id;
+} Type;
+
+const Type TYPE_NUMBER = { .id = 0 };
+const Type TYPE_BOOL = { .id = 1 };
+// the type of anything whose error has already been reported. it matches every type, so that one mistake is not
+// reported again wherever its result is used
+const Type TYPE_ERROR = { .id = 2 };
+
+void lexer_scan(Lexer *lexer)
+{
+	perf_enter(PERF_PHASE_LEX);
+	lexer_scan_token(lexer);
+	perf_exit();
+}
+
+bool type_from_name(const char *name, Type *ty)
+{
+	if (strcmp(name, "number") == 0)
+	{
+		*ty = TYPE_NUMBER;
+		return true;
+	}
+	if (strcmp(name, "boolean") == 0)
+	{
+		*ty = TYPE_BOOL;
+		return true;
+	}
+	// not an identifier, so it can only come from an exported alias whose type could not be resolved
+	if (strcmp(name, "(error)") == 0)
+	{
+		*ty = TYPE_ERROR;
+		return true;
+	}
+	return false;
+}
+
+const char *type_name(Type ty)
+{
+	switch (ty.id)
+	{
+	case 0:
+		return "number";
+	case 1:
+		return "boolean";
+	case 2:
+		return "(error)";
+	default:
+		return "(unknown type)";
+	}
+}
+
+bool type_matches(Type a, Type b)
+{
+	return a.id == b.id || a.id == TYPE_ERROR.id || b.id == TYPE_ERROR.id;
+}
+
+typedef enum
+{
+	EXPR_IDENT,
+	EXPR_NUM,
+	EXPR_BOOL,
+	EXPR_ASSIGNMENT,
+	EXPR_CALL,
+	// an expression that failed to check, e.g. a reference to an undeclared name. it has TYPE_ERROR
+	EXPR_ERROR,
+} ExprKind;
+
+typedef struct
+{
+	Symbol sym;
+} Ident;
+
+typedef struct
+{
+	double value;
+} Number;
+
+typedef struct Expr_ Expr;
+
+typedef struct
+{
+	Ident name;
+	Expr *expr;
+} Assignment;
+
+typedef struct
+{
+	Ident callee;
+	// stretchy buffer
+	Expr *args;
+} Call;
+
+struct Expr_
+{
+	ExprKind kind;
+	Location location;
+
+	union
+	{
+		// EXPR_IDENT
+		Ident ident;
+		// EXPR_NUM
+		Number num;
+		// EXPR_BOOL
+		bool boolean;
+		// EXPR_ASSIGNMENT
+		Assignment assignment;
+		// EXPR_CALL
+		Call call;
+	};
+};
+
+Expr expr_ident_create(Location location, Symbol sym)
+{
+	Expr expr;
+	expr.kind = EXPR_IDENT;
+	expr.location = location;
+	Ident ident = { .sym = sym };
+	expr.ident = ident;
+	return expr;
+}
+
+Expr expr_num_create(Location location, double value)
+{
+	Expr expr;
+	expr.kind = EXPR_NUM;
+	expr.location = location;
+	Number num = { .value = value };
+	expr.num = num;
+	return expr;
+}
+
+Expr expr_assignment_create(Location location, Ident name, Expr *value)
+{
+	Assignment assignment = { .expr = value, .name = name };
+	Expr expr = {
+		.kind = EXPR_ASSIGNMENT,
+		.location = location,
+		.assignment = assignment,
+	};
+	return expr;
+}
+
+Expr expr_call_create(Location location, Ident callee, Expr *args)
+{
+	Call call = { .callee = callee, .args = args };
+	Expr expr = {
+		.kind = EXPR_CALL,
+		.location = location,
+		.call = call,
+	};
+	return expr;
+}
+
+Expr expr_bool_create(Location location, bool value)
+{
+	Expr expr = {
+		.kind = EXPR_BOOL,
+		.location = location,
+		.boolean = value,
+	};
+	return expr;
+}
+
+Expr expr_error_create(Location location)
+{
+	Expr expr = {
+		.kind = EXPR_ERROR,
+		.location = location,
+	};
+	return expr;
+}
+
+typedef struct Scope_ Scope;
+typedef struct Stmt_ Stmt;
+
+typedef enum
+{
+	DECL_LET,
+	DECL_TYPE_ALIAS,
+	DECL_RESOLVED_LET,
+	DECL_FUNCTION,
+	// a name whose declaration failed. it has TYPE_ERROR whether it is used as a value or as a type, so that its uses
+	// are not reported as undeclared
+	DECL_ERROR,
+} DeclKind;
+
+typedef struct
+{
+	Ident name;
+	Ident *type_name;
+	Expr init;
+	// the type of init, inferred once when the let is declared so that a chain of lets initialized with each other is
+	// not walked again for every use. not set if it could not be inferred
+	bool typed;
+	Type ty;
+} Let;
+
+typedef struct
+{
+	Ident name;
+	Ident type_name;
+} TypeAlias;
+
+// a let binding whose type is already known, e.g. one imported from another module
+typedef struct
+{
+	Ident name;
+	Type ty;
+} ResolvedLet;
+
+typedef struct
+{
+	Ident name;
+	Ident type_name;
+	Type ty;
+} Param;
+
+typedef struct
+{
+	Ident name;
+	// stretchy buffer
+	Param *params;
+	Ident return_type_name;
+	Type return_ty;
+	// stretchy buffer. NULL in the scope, which only needs the signature
+	Stmt *body;
+} Function;
+
+typedef struct
+{
+	DeclKind kind;
+	Location location;
+	// where the declared name starts, so that references can be traced back to it. SIZE_MAX for builtins and for
+	// exports read from a summary
+	size_t name_pos;
+	bool exported;
+
+	union
+	{
+		// DECL_LET
+		Let let;
+		// DECL_TYPE_ALIAS
+		TypeAlias type_alias;
+		// DECL_RESOLVED_LET
+		ResolvedLet resolved_let;
+		// DECL_FUNCTION
+		Function function;
+	};
+} Decl;
+
+bool expr_infer_type(Expr expr, Scope *scope, Type *ty);
+
+Decl decl_let_create(Location location, Ident name, Ident *type_name, Expr init)
+{
+	Decl decl;
+	decl.kind = DECL_LET;
+	decl.location = location;
+	decl.name_pos = SIZE_MAX;
+	decl.exported = false;
+
+	Let let = { .name = name, .type_name = type_name, .init = init, .typed = false, .ty = { 0 } };
+	decl.let = let;
+
+	return decl;
+}
+
+Decl decl_type_alias_create(Location location, Ident name, Ident type_name)
+{
+	Decl decl;
+	decl.kind = DECL_TYPE_ALIAS;
+	decl.location = location;
+	decl.name_pos = SIZE_MAX;
+	decl.exported = false;
+	TypeAlias type_alias = { .name = name, .type_name = type_name };
+	decl.type_alias = type_alias;
+	return decl;
+}
+
+Expr expr_leaf(Expr expr)
+{
+	while (expr.kind == EXPR_ASSIGNMENT)
+	{
+		expr = *expr.assignment.expr;
+	}
+	return expr;
+}
+
+Decl decl_resolved_let_create(Location location, Ident name, Type ty)
+{
+	Decl decl;
+	decl.kind = DECL_RESOLVED_LET;
+	decl.location = location;
+	decl.name_pos = SIZE_MAX;
+	decl.exported = false;
+	ResolvedLet resolved_let = { .name = name, .ty = ty };
+	decl.resolved_let = resolved_let;
+	return decl;
+}
+
+Decl decl_error_create(Location location)
+{
+	Decl decl;
+	decl.kind = DECL_ERROR;
+	decl.location = location;
+	decl.name_pos = SIZE_MAX;
+	decl.exported = false;
+	return decl;
+}
+
+Decl decl_function_create(Location location, Ident name, Param *params, Ident return_type_name, Type return_ty)
+{
+	Decl decl;
+	decl.kind = DECL_FUNCTION;
+	decl.location = location;
+	decl.name_pos = SIZE_MAX;
+	decl.exported = false;
+	Function function = {
+		.name = name,
+		.params = params,
+		.return_type_name = return_type_name,
+		.return_ty = return_ty,
+		.body = NULL,
+	};
+	decl.function = function;
+	return decl;
+}
+
+typedef enum
+{
+	STMT_EXPR,
+	STMT_DECL,
+	STMT_IMPORT,
+	STMT_RETURN,
+	// a statement that failed to parse, from where it starts up to where parsing picked up again
+	STMT_ERROR,
+} StmtKind;
+
+typedef struct
+{
+	// stretchy buffer
+	Ident *names;
+	const char *specifier;
+} Import;
+
+struct Stmt_
+{
+	StmtKind kind;
+	Location location;
+
+	union
+	{
+		// STMT_EXPR and STMT_RETURN
+		Expr expr;
+		// STMT_DECL
+		Decl decl;
+		// STMT_IMPORT
+		Import import;
+	};
+};
+
+Stmt stmt_expr_create(Location location, Expr expr)
+{
+	Stmt stmt;
+	stmt.kind = STMT_EXPR;
+	stmt.location = location;
+	stmt.expr = expr;
+	return stmt;
+}
+
+Stmt stmt_decl_create(Location location, Decl decl)
+{
+	Stmt stmt;
+	stmt.kind = STMT_DECL;
+	stmt.location = location;
+	stmt.decl = decl;
+	return stmt;
+}
+
+Stmt stmt_return_create(Location location, Expr expr)
+{
+	Stmt stmt;
+	stmt.kind = STMT_RETURN;
+	stmt.location = location;
+	stmt.expr = expr;
+	return stmt;
+}
+
+Stmt stmt_error_create(Location location)
+{
+	Stmt stmt;
+	stmt.kind = STMT_ERROR;
+	stmt.location = location;
+	return stmt;
+}
+
+Stmt stmt_import_create(Location location, Ident *names, const char *specifier)
+{
+	Stmt stmt;
+	stmt.kind = STMT_IMPORT;
+	stmt.location = location;
+	Import import = { .names = names, .specifier = specifier };
+	stmt.import = import;
+	return stmt;
+}
+
+#define UNREACHABLE(...)                                                                                               \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        fprintf(stderr, "unreachable: " __VA_ARGS__);                                                                  \
+        exit(1);                                                                                                       \
+    } while (0)
+
+typedef struct
+{
+	bool in_use;
+	Symbol key;
+	Decl val;
+} HashmapEntry;
+
+typedef struct
+{
+	size_t cap;
+	size_t size;
+	HashmapEntry *entries;
+} Hashmap;
+
+void hm_init(Hashmap *hm)
+{
+	hm->cap = 2;
+	hm->size = 0;
+	hm->entries = calloc(hm->cap, sizeof(HashmapEntry));
+}
+
+// where probing for `key` starts in a map with `cap` slots. symbols are numbered densely, so they are scattered with a
+// multiplicative hash
+size_t hm_first_slot(Symbol key, size_t cap)
+{
+	uint64_t hash = key * 0x9E3779B97F4A7C15ull;
+	return (size_t)(hash ^ (hash >> 32)) & (cap - 1);
+}
+
+// the slot that holds `key`, or the empty slot where it would go. collisions are probed linearly. the map is never more
+// than half full, so an empty slot is always found
+size_t hm_find(Hashmap *hm, Symbol key)
+{
+	size_t mask = hm->cap - 1;
+	for (size_t i = hm_first_slot(key, hm->cap);; i = (i + 1) & mask)
+	{
+		if (!hm->entries[i].in_use || hm->entries[i].key == key)
+		{
+			return i;
+		}
+	}
+}
+
+// grows the map until it can hold `min_size` entries while staying at most half full. the capacity stays a power of 2
+void hm_ensure(Hashmap *hm, size_t min_size)
+{
+	if (hm->cap / 2 >= min_size)
+	{
+		return;
+	}
+
+	size_t prev_cap = hm->cap;
+	HashmapEntry *prev_entries = hm->entries;
+	while (hm->cap / 2 < min_size)
+	{
+		hm->cap *= 2;
+	}
+	hm->entries = calloc(hm->cap, sizeof(HashmapEntry));
+	if (!hm->entries)
+	{
+		fprintf(stderr, "out of memory: could not grow a scope to %zu entries\n", hm->cap);
+		exit(1);
+	}
+	for (size_t i = 0; i < prev_cap; i++)
+	{
+		if (prev_entries[i].in_use)
+		{
+			hm->entries[hm_find(hm, prev_entries[i].key)] = prev_entries[i];
+		}
+	}
+	free(prev_entries);
+}
+
+void hm_add(Hashmap *hm, Symbol key, Decl val)
+{
+	size_t i = hm_find(hm, key);
+	if (hm->entries[i].in_use)
+	{
+		hm->entries[i].val = val;
+		return;
+	}
+
+	if (hm->cap / 2 < hm->size + 1)
+	{
+		hm_ensure(hm, hm->size + 1);
+		i = hm_find(hm, key);
+	}
+	HashmapEntry entry = { .in_use = true, .key = key, .val = val };
+	hm->entries[i] = entry;
+	hm->size++;
+}
+
+bool hm_get(Hashmap *hm, Symbol key, Decl *result)
+{
+	perf_enter(PERF_PHASE_LOOKUP);
+	HashmapEntry *entry = &hm->entries[hm_find(hm, key)];
+	bool found = entry->in_use;
+	if (found)
+	{
+		*result = entry->val;
+	}
+	perf_exit();
+
+	return found;
+}
+
+bool hm_has(Hashmap *hm, Symbol key)
+{
+	Decl dummy;
+	return hm_get(hm, key, &dummy);
+}
+
+// removes every entry but keeps the capacity
+void hm_clear(Hashmap *hm)
+{
+	memset(hm->entries, 0, sizeof(HashmapEntry) * hm->cap);
+	hm->size = 0;
+}
+
+// what a streaming parser keeps of a module-level declaration, see Parser.stream. lookups only need its kind, its type
+// and where its name is, which takes a quarter of the space of a Decl
+typedef struct
+{
+	DeclKind kind;
+	// the type of a let or resolved let, or the return type of a function
+	Type ty;
+	union
+	{
+		// DECL_LET, whether `ty` is set
+		bool typed;
+		// DECL_TYPE_ALIAS
+		Symbol type_name;
+		// DECL_FUNCTION, stretchy buffer
+		Param *params;
+	};
+	size_t name_pos;
+} CompactDecl;
+
+CompactDecl compact_decl_create(Decl decl)
+{
+	CompactDecl compact = { .kind = decl.kind, .ty = TYPE_ERROR, .name_pos = decl.name_pos };
+	switch (decl.kind)
+	{
+	case DECL_LET:
+		compact.typed = decl.let.typed;
+		compact.ty = decl.let.ty;
+		break;
+	case DECL_TYPE_ALIAS:
+		compact.type_name = decl.type_alias.type_name.sym;
+		break;
+	case DECL_RESOLVED_LET:
+		compact.ty = decl.resolved_let.ty;
+		break;
+	case DECL_FUNCTION:
+		compact.params = decl.function.params;
+		compact.ty = decl.function.return_ty;
+		break;
+	case DECL_ERROR:
+		break;
+	}
+	return compact;
+}
+
+// the declaration of `name` as far as lookups can tell. a let has no initializer, which is only needed to infer its
+// type, and that was done when it was declared
+Decl compact_decl_expand(Symbol name, CompactDecl compact)
+{
+	Location location = { .pos = compact.name_pos };
+	Ident ident = { .sym = name };
+	Decl decl;
+	switch (compact.kind)
+	{
+	case DECL_LET:
+		decl = decl_let_create(location, ident, NULL, expr_error_create(location));
+		decl.let.typed = compact.typed;
+		decl.let.ty = compact.ty;
+		break;
+	case DECL_TYPE_ALIAS:
+		decl = decl_type_alias_create(location, ident, (Ident){ .sym = compact.type_name });
+		break;
+	case DECL_RESOLVED_LET:
+		decl = decl_resolved_let_create(location, ident, compact.ty);
+		break;
+	case DECL_FUNCTION:
+		// the name of the return type is only needed to write the AST, which streaming doesn't keep
+		decl = decl_function_create(location, ident, compact.params, ident, compact.ty);
+		break;
+	default:
+		decl = decl_error_create(location);
+		break;
+	}
+	decl.name_pos = compact.name_pos;
+	return decl;
+}
+
+typedef struct
+{
+	bool in_use;
+	Symbol key;
+	CompactDecl val;
+} CompactMapEntry;
+
+// a Hashmap of CompactDecls
+typedef struct
+{
+	size_t cap;
+	size_t size;
+	CompactMapEntry *entries;
+} CompactMap;
+
+void cm_init(CompactMap *cm)
+{
+	cm->cap = 2;
+	cm->size = 0;
+	cm->entries = calloc(cm->cap, sizeof(CompactMapEntry));
+}
+
+// see hm_find
+size_t cm_find(CompactMap *cm, Symbol key)
+{
+	size_t mask = cm->cap - 1;
+	for (size_t i = hm_first_slot(key, cm->cap);; i = (i + 1) & mask)
+	{
+		if (!cm->entries[i].in_use || cm->entries[i].key == key)
+		{
+			return i;
+		}
+	}
+}
+
+void cm_add(CompactMap *cm, Symbol key, CompactDecl val)
+{
+	size_t i = cm_find(cm, key);
+	if (cm->entries[i].in_use)
+	{
+		cm->entries[i].val = val;
+		return;
+	}
+
+	if (cm->cap / 2 < cm->size + 1)
+	{
+		size_t prev_cap = cm->cap;
+		CompactMapEntry *prev_entries = cm->entries;
+		cm->cap *= 2;
+		cm->entries = calloc(cm->cap, sizeof(CompactMapEntry));
+		if (!cm->entries)
+		{
+			fprintf(stderr, "out of memory: could not grow a scope to %zu entries\n", cm->cap);
+			exit(1);
+		}
+		for (size_t j = 0; j < prev_cap; j++)
+		{
+			if (prev_entries[j].in_use)
+			{
+				cm->entries[cm_find(cm, prev_entries[j].key)] = prev_entries[j];
+			}
+		}
+		free(prev_entries);
+		i = cm_find(cm, key);
+	}
+	CompactMapEntry entry = { .in_use = true, .key = key, .val = val };
+	cm->entries[i] = entry;
+	cm->size++;
+}
+
+bool cm_get(CompactMap *cm, Symbol key, CompactDecl *result)
+{
+	perf_enter(PERF_PHASE_LOOKUP);
+	CompactMapEntry *entry = &cm->entries[cm_find(cm, key)];
+	bool found = entry->in_use;
+	if (found)
+	{
+		*result = entry->val;
+	}
+	perf_exit();
+
+	return found;
+}
+
+struct Scope_
+{
+	Scope *parent;
+	Hashmap bindings;
+	// if set, new declarations go to `compact_bindings` rather than `bindings`. see scope_make_compact
+	bool compact;
+	CompactMap compact_bindings;
+};
+
+void scope_init(Scope *scope, Scope *parent)
+{
+	scope->parent = parent;
+	hm_init(&scope->bindings);
+	scope->compact = false;
+}
+
+// keeps only what lookups need of the declarations made in `s` from now on, see CompactDecl. the ones already made,
+// e.g. builtins, stay where they are
+void scope_make_compact(Scope *s)
+{
+	s->compact = true;
+	cm_init(&s->compact_bindings);
+}
+
+bool scope_get_local_value(Scope *s, Symbol name, Decl *decl)
+{
+	if (hm_get(&s->bindings, name, decl))
+	{
+		return true;
+	}
+
+	CompactDecl compact;
+	if (s->compact && cm_get(&s->compact_bindings, name, &compact))
+	{
+		*decl = compact_decl_expand(name, compact);
+		return true;
+	}
+
+	return false;
+}
+
+bool scope_get_value(Scope *s, Symbol name, Decl *decl)
+{
+	for (; s != NULL; s = s->parent)
+	{
+		if (scope_get_local_value(s, name, decl))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void scope_declare(Scope *s, Symbol name, Decl decl)
+{
+	if (s->compact)
+	{
+		cm_add(&s->compact_bindings, name, compact_decl_create(decl));
+		return;
+	}
+	hm_add(&s->bindings, name, decl);
+}
+
+bool scope_is_declared(Scope *s, Symbol name)
+{
+	Decl dummy;
+	return scope_get_value(s, name, &dummy);
+}
+
+// whether `name` is declared in `s` itself rather than in one of its parents, which it may shadow
+bool scope_is_declared_locally(Scope *s, Symbol name)
+{
+	Decl dummy;
+	return scope_get_local_value(s, name, &dummy);
+}
+
+// scopes are recycled rather than allocated for every function body, so that modules with many small functions don't
+// allocate and initialise a hashmap for each of them
+typedef struct
+{
+	// stretchy buffer
+	Scope **free;
+} ScopePool;
+
+// scopes whose hashmap grew past this are freed rather than recycled, so that clearing them stays cheap
+#define SCOPE_POOL_MAX_CAP 64
+
+Scope *scope_pool_acquire(ScopePool *pool, Scope *parent)
+{
+	if (sbcount(pool->free) == 0)
+	{
+		Scope *scope = malloc(sizeof(Scope));
+		scope_init(scope, parent);
+		return scope;
+	}
+
+	Scope *scope = pool->free[--stb__sbn(pool->free)];
+	scope->parent = parent;
+	return scope;
+}
+
+void scope_pool_release(ScopePool *pool, Scope *scope)
+{
+	if (scope->bindings.cap > SCOPE_POOL_MAX_CAP)
+	{
+		free(scope->bindings.entries);
+		free(scope);
+		return;
+	}
+
+	hm_clear(&scope->bindings);
+	sbpush(pool->free, scope);
+}
+
+// follows type aliases until reaching a builtin type. aliases can only refer to types declared before them, so the
+// chain always ends
+bool scope_resolve_type(Scope *s, Symbol name, Type *ty)
+{
+	while (!type_from_name(symbol_text(name), ty))
+	{
+		Decl decl;
+		if (!scope_get_value(s, name, &decl))
+		{
+			return false;
+		}
+		if (decl.kind == DECL_ERROR)
+		{
+			*ty = TYPE_ERROR;
+			return true;
+		}
+		if (decl.kind != DECL_TYPE_ALIAS)
+		{
+			return false;
+		}
+		name = decl.type_alias.type_name.sym;
+	}
+	return true;
+}
+
+// the type of an expression is the type of whatever is at the end of its chain of assignments and identifiers, so this
+// is a loop rather than a recursion: deep chains take constant stack and memory. identifiers can only refer to
+// declarations before them, so the chain always ends
+bool expr_infer_chain_type(Expr expr, Scope *scope, Type *ty)
+{
+	while (true)
+	{
+		switch (expr.kind)
+		{
+		case EXPR_IDENT:
+		{
+			Decl decl;
+			if (!scope_get_value(scope, expr.ident.sym, &decl))
+			{
+				return false;
+			}
+			if (decl.kind == DECL_RESOLVED_LET)
+			{
+				*ty = decl.resolved_let.ty;
+				return true;
+			}
+			if (decl.kind == DECL_ERROR)
+			{
+				*ty = TYPE_ERROR;
+				return true;
+			}
+			if (decl.kind != DECL_LET)
+			{
+				return false;
+			}
+			// the type was inferred when the binding was declared. if that failed, inferring it here would look up the
+			// names in its initializer in the wrong scope, where they may be shadowed
+			if (!decl.let.typed)
+			{
+				return false;
+			}
+			*ty = decl.let.ty;
+			return true;
+		}
+		case EXPR_ASSIGNMENT:
+			expr = *expr.assignment.expr;
+			break;
+		case EXPR_CALL:
+		{
+			Decl decl;
+			if (!scope_get_value(scope, expr.call.callee.sym, &decl) || decl.kind != DECL_FUNCTION)
+			{
+				return false;
+			}
+			*ty = decl.function.return_ty;
+			return true;
+		}
+		case EXPR_NUM:
+			*ty = TYPE_NUMBER;
+			return true;
+		case EXPR_BOOL:
+			*ty = TYPE_BOOL;
+			return true;
+		case EXPR_ERROR:
+			*ty = TYPE_ERROR;
+			return true;
+		default:
+			UNREACHABLE("unexpected expr of kind '%d'\n", expr.kind);
+		}
+	}
+}
+
+bool expr_infer_type(Expr expr, Scope *scope, Type *ty)
+{
+	perf_enter(PERF_PHASE_INFER);
+	bool ok = expr_infer_chain_type(expr, scope, ty);
+	perf_exit();
+	return ok;
+}
+
+
+typedef struct
+{
+	Stmt *statements;
+} Module;
+
+#define DEFAULT_MAX_EXPR_DEPTH 100000
+
+// the target of one assignment in a chain like `a = b = c`, waiting for the value on its right to be parsed
+typedef struct
+{
+	Location location;
+	Ident name;
+} PendingAssignment;
+
+typedef struct
+{
+	bool inside;
+	Type return_ty;
+	// whether the body has a return statement, which must then be checked against return_ty
+	bool returned;
+} FunctionContext;
+
+// calls are parsed recursively, so unlike assignments their nesting is also limited by the stack. it is limited by
+// max_expr_depth as well, up to this
+#define MAX_CALL_DEPTH 1000
+
+// a module specifier from an import statement, resolved to the exports of the module it refers to
+typedef struct
+{
+	const char *specifier;
+	// NULL if the module could not be found or checked
+	Hashmap *exports;
+} ResolvedImport;
+
+typedef enum
+{
+	PARSE_RESULT_OK,
+	PARSE_RESULT_UNEXPECTED_TOK,
+	PARSE_RESULT_INVALID_NUMERIC_LITERAL,
+	PARSE_RESULT_CANNOT_REDECLARE,
+	PARSE_RESULT_UNDECLARED,
+	PARSE_RESULT_COULD_NOT_INFER_EXPR_TYPE,
+	PARSE_RESULT_MODULE_NOT_FOUND,
+	PARSE_RESULT_IMPORT_CYCLE,
+	PARSE_RESULT_TOO_DEEP,
+	PARSE_RESULT_NOT_CALLABLE,
+	PARSE_RESULT_WRONG_ARG_COUNT,
+	PARSE_RESULT_MISSING_RETURN,
+	PARSE_RESULT_X,
+} ParseResult;
+
+// an identifier in the source and the declaration it resolves to, so that a position can be mapped to what is there
+// without checking the module again
+typedef struct
+{
+	// [start, end) in bytes
+	size_t start;
+	size_t end;
+	Symbol name;
+	DeclKind decl_kind;
+	// see Decl.name_pos
+	size_t decl_pos;
+	// the type of a binding, the type an alias resolves to or the return type of a function. not set if it could not
+	// be inferred
+	bool typed;
+	Type ty;
+} Span;
+
+typedef struct
+{
+	Lexer *lexer;
+	Scope *scope;
+	bool has_errors;
+	// where errors are printed. stderr, unless the module is checked as part of a program
+	FILE *diagnostics;
+	// stretchy buffer, the imports of this module must be resolved before it is parsed
+	ResolvedImport *imports;
+	Hashmap exports;
+	// how many assignments an expression may nest
+	size_t max_expr_depth;
+	// stretchy buffer, reused by every call to parse_expression
+	PendingAssignment *pending_assignments;
+	// if set, statements are freed as soon as they have been checked instead of being kept in the module, and only
+	// what later lookups need is kept in the scope
+	bool stream;
+	// stretchy buffer, the parameters of declared functions whose statements were freed or discarded while the scope
+	// still refers to their signatures, see parser_keep_params
+	Param **kept_params;
+	// scopes of function bodies
+	ScopePool scope_pool;
+	// the function whose body is being parsed
+	FunctionContext function;
+	// how many calls the current expression is nested in
+	size_t call_depth;
+	// the first error in the module, see parser_fail
+	ParseResult result;
+	// set while a let, type or function statement has checked the name it declares but not declared it yet. if the
+	// statement fails in between, the name is declared with DECL_ERROR, see parser_fail_stmt
+	bool declaring;
+	Symbol declaring_name;
+	size_t declaring_pos;
+	// if set, every identifier that resolves to a declaration is recorded in `spans`
+	bool index_spans;
+	// stretchy buffer, in the order the identifiers were resolved. see span_index_sort
+	Span *spans;
+} Parser;
+
+char *parse_result_name(ParseResult res)
+{
+	switch (res)
+	{
+	case PARSE_RESULT_OK:
+		return "PARSE_RESULT_OK";
+	case PARSE_RESULT_UNEXPECTED_TOK:
+		return "PARSE_RESULT_UNEXPECTED_TOK";
+	case PARSE_RESULT_INVALID_NUMERIC_LITERAL:
+		return "PARSE_RESULT_INVALID_NUMERIC_LITERAL";
+	case PARSE_RESULT_CANNOT_REDECLARE:
+		return "PARSE_RESULT_CANNOT_REDECLARE";
+	case PARSE_RESULT_UNDECLARED:
+		return "PARSE_RESULT_UNDECLARED";
+	case PARSE_RESULT_COULD_NOT_INFER_EXPR_TYPE:
+		return "PARSE_RESULT_COULD_NOT_INFER_EXPR_TYPE";
+	case PARSE_RESULT_MODULE_NOT_FOUND:
+		return "PARSE_RESULT_MODULE_NOT_FOUND";
+	case PARSE_RESULT_IMPORT_CYCLE:
+		return "PARSE_RESULT_IMPORT_CYCLE";
+	case PARSE_RESULT_TOO_DEEP:
+		return "PARSE_RESULT_TOO_DEEP";
+	case PARSE_RESULT_NOT_CALLABLE:
+		return "PARSE_RESULT_NOT_CALLABLE";
+	case PARSE_RESULT_WRONG_ARG_COUNT:
+		return "PARSE_RESULT_WRONG_ARG_COUNT";
+	case PARSE_RESULT_MISSING_RETURN:
+		return "PARSE_RESULT_MISSING_RETURN";
+	case PARSE_RESULT_X:
+		return "PARSE_RESULT_X";
+	default:
+		return "(unknown)";
+	}
+}
+
+#define TRY_PARSE(__expr) \
+    do { \
+        ParseResult __res = __expr; \
+        if (__res != PARSE_RESULT_OK) return __res; \
+    } while (0)
+
+Parser *parser_create(Lexer *lexer)
+{
+	Parser *parser = malloc(sizeof(Parser));
+	parser->lexer = lexer;
+	parser->has_errors = false;
+	parser->diagnostics = stderr;
+	parser->imports = NULL;
+	hm_init(&parser->exports);
+	parser->max_expr_depth = DEFAULT_MAX_EXPR_DEPTH;
+	parser->pending_assignments = NULL;
+	parser->stream = false;
+	parser->kept_params = NULL;
+	parser->scope_pool.free = NULL;
+	parser->function = (FunctionContext){ .inside = false };
+	parser->call_depth = 0;
+	parser->result = PARSE_RESULT_OK;
+	parser->declaring = false;
+	parser->index_spans = false;
+	parser->spans = NULL;
+
+	parser->scope = malloc(sizeof(Scope));
+	scope_init(parser->scope, NULL);
+
+	Ident number = { .sym = intern_string("number") };
+	scope_declare(parser->scope, number.sym, decl_type_alias_create((Location){ 0 }, number, number));
+	Ident boolean = { .sym = intern_string("boolean") };
+	scope_declare(parser->scope, boolean.sym, decl_type_alias_create((Location){ 0 }, boolean, boolean));
+
+	return parser;
+}
+
+// frees the parser and its lexer, but nothing that ended up in the module or the exports
+void parser_free(Parser *parser)
+{
+	lexer_seek(parser->lexer, 0);
+	free(parser->lexer);
+	for (Scope *scope = parser->scope; scope != NULL;)
+	{
+		Scope *parent = scope->parent;
+		free(scope->bindings.entries);
+		if (scope->compact)
+		{
+			free(scope->compact_bindings.entries);
+		}
+		free(scope);
+		scope = parent;
+	}
+	for (size_t i = 0; i < sbcount(parser->scope_pool.free); i++)
+	{
+		free(parser->scope_pool.free[i]->bindings.entries);
+		free(parser->scope_pool.free[i]);
+	}
+	sbfree(parser->scope_pool.free);
+	for (size_t i = 0; i < sbcount(parser->kept_params); i++)
+	{
+		sbfree(parser->kept_params[i]);
+	}
+	sbfree(parser->kept_params);
+	sbfree(parser->imports);
+	sbfree(parser->pending_assignments);
+	free(parser);
+}
+
+// at most this many bytes on either side of an error are printed, so that each error on a very long line costs the same
+#define ERROR_CONTEXT_BYTES 120
+
+void parser_print_error_context(Parser *parser)
+{
+	const char *source = parser->lexer->source;
+	size_t source_len = parser->lexer->source_len;
+	size_t pos = parser->lexer->pos;
+	size_t window_start = pos > ERROR_CONTEXT_BYTES ? pos - ERROR_CONTEXT_BYTES : 0;
+	size_t window_end = source_len - pos > ERROR_CONTEXT_BYTES ? pos + ERROR_CONTEXT_BYTES : source_len;
+
+	// finding the part of the line that the error occurred on
+	size_t line_start = pos;
+	size_t line_end = pos;
+	// first, find the start of the line, then ...
+	while (line_start > window_start && source[line_start - 1] != '\n')
+	{
+		line_start--;
+	}
+	// ... find the end of the line
+	while (line_end < window_end && source[line_end] != '\n')
+	{
+		line_end++;
+	}
+
+	// a line that is cut short is cut between code points
+	bool cut_start = line_start > 0 && source[line_start - 1] != '\n';
+	while (cut_start && line_start < pos && (source[line_start] & 0xC0) == 0x80)
+	{
+		line_start++;
+	}
+	bool cut_end = line_end < source_len && source[line_end] != '\n';
+	while (cut_end && line_end > pos && (source[line_end] & 0xC0) == 0x80)
+	{
+		line_end--;
+	}
+
+	fprintf(parser->diagnostics, "%s%.*s%s", cut_start ? "..." : "", (int)(line_end - line_start), source + line_start,
+		cut_end ? "...\n" : line_end < source_len ? "\n" : "");
+
+	// pad by code points rather than bytes so that the caret lines up under non-ASCII identifiers
+	size_t padding_size = cut_start ? 3 : 0;
+	for (size_t i = line_start; i + 1 < pos; i++)
+	{
+		if ((source[i] & 0xC0) != 0x80)
+		{
+			padding_size++;
+		}
+	}
+
+	fprintf(parser->diagnostics, "%*s^ ", (int)padding_size, "");
+}
+
+#define PARSER_ERROR(...) \
+    do {                  \
+        if (parser->has_errors) break; \
+        parser->has_errors = true; \
+        parser_print_error_context(parser); \
+        fprintf(parser->diagnostics, __VA_ARGS__); \
+    } while (0)
+
+// records that the module has an error, keeping the first one as its result
+void parser_fail(Parser *parser, ParseResult res)
+{
+	if (parser->result == PARSE_RESULT_OK)
+	{
+		parser->result = res;
+	}
+}
+
+// reports an error that checking carries on after, with TYPE_ERROR or an error node in place of whatever failed. the
+// statement does not fail, so unlike PARSER_ERROR this can report several errors in one statement
+#define PARSER_CHECK_ERROR(__res, ...) \
+    do { \
+        parser_print_error_context(parser); \
+        fprintf(parser->diagnostics, __VA_ARGS__); \
+        parser_fail(parser, __res); \
+    } while (0)
+
+bool parser_try_parse_token(Parser *parser, TokenKind kind)
+{
+	bool ok = parser->lexer->token != NULL && parser->lexer->token->kind == kind;
+	if (ok)
+	{
+		lexer_scan(parser->lexer);
+	}
+	return ok;
+}
+
+ParseResult parser_expect_token(Parser *parser, TokenKind kind)
+{
+	bool ok = parser_try_parse_token(parser, kind);
+	if (!ok)
+	{
+		PARSER_ERROR("expected a token of kind %s, got %s\n",
+			token_kind_name(kind),
+			token_kind_name(parser->lexer->token->kind));
+		return PARSE_RESULT_UNEXPECTED_TOK;
+	}
+	return PARSE_RESULT_OK;
+}
+
+ParseResult parse_call(Parser *parser, Location location, Expr *expr);
+void expr_free(Expr *expr);
+void stmt_free(Stmt *stmt);
+
+// records that the identifier `name` ending at `end` resolves to `decl`. the type is worked out now, while the scope
+// that `decl` is visible in is still around
+void parser_index_name(Parser *parser, Symbol name, size_t end, Decl *decl)
+{
+	if (!parser->index_spans)
+	{
+		return;
+	}
+
+	Span span = {
+		.start = end - symbol_len(name),
+		.end = end,
+		.name = name,
+		.decl_kind = decl->kind,
+		.decl_pos = decl->name_pos,
+	};
+	switch (decl->kind)
+	{
+	case DECL_LET:
+		span.typed = decl->let.typed;
+		span.ty = decl->let.ty;
+		break;
+	case DECL_RESOLVED_LET:
+		span.typed = true;
+		span.ty = decl->resolved_let.ty;
+		break;
+	case DECL_TYPE_ALIAS:
+		span.typed = scope_resolve_type(parser->scope, decl->type_alias.type_name.sym, &span.ty);
+		break;
+	case DECL_FUNCTION:
+		span.typed = true;
+		span.ty = decl->function.return_ty;
+		break;
+	case DECL_ERROR:
+		span.typed = true;
+		span.ty = TYPE_ERROR;
+		break;
+	}
+	sbpush(parser->spans, span);
+}
+
+ParseResult parse_identifier_or_literal(Parser *parser, Expr *expr)
+{
+	size_t pos = parser->lexer->pos;
+	Location location = { .pos = pos };
+	if (parser_try_parse_token(parser, TOK_IDENT))
+	{
+		*expr = expr_ident_create(location, parser->lexer->prev_token->sym);
+		if (parser->lexer->token->kind == TOK_LPAREN)
+		{
+			return parse_call(parser, location, expr);
+		}
+		return PARSE_RESULT_OK;
+	}
+
+	if (parser_try_parse_token(parser, TOK_NUMBER))
+	{
+		char *end_ptr;
+		errno = 0;
+		double value = strtod(parser->lexer->prev_token->text, &end_ptr);
+		if (errno == ERANGE)
+		{
+			PARSER_CHECK_ERROR(PARSE_RESULT_INVALID_NUMERIC_LITERAL, "could not parse as double: %s\n",
+				parser->lexer->prev_token->text);
+		}
+		*expr = expr_num_create(location, value);
+		return PARSE_RESULT_OK;
+	}
+
+	if (parser_try_parse_token(parser, TOK_BOOL))
+	{
+		bool value = STRNCMP(parser->lexer->prev_token->text, "true");
+		*expr = expr_bool_create(location, value);
+		return PARSE_RESULT_OK;
+	}
+
+	PARSER_ERROR("expected identifier or a literal but got %s\n", token_kind_name(parser->lexer->token->kind));
+	return PARSE_RESULT_UNEXPECTED_TOK;
+}
+
+// assignments nest to the right, so instead of recursing for every `=`, the targets are pushed on an explicit stack and
+// the assignments are built innermost first once the value at the end of the chain has been parsed. the targets of
+// this expression are the ones above `base`, those below belong to the expressions of enclosing calls
+ParseResult parse_assignment_chain(Parser *parser, Expr *expr, size_t base)
+{
+	while (true)
+	{
+		size_t pos = parser->lexer->pos;
+		Location location = { .pos = pos };
+
+		TRY_PARSE(parse_identifier_or_literal(parser, expr));
+
+		bool declared = true;
+		if (expr->kind == EXPR_IDENT)
+		{
+			Decl decl;
+			declared = scope_get_value(parser->scope, expr->ident.sym, &decl);
+			if (declared)
+			{
+				parser_index_name(parser, expr->ident.sym, pos, &decl);
+			}
+			else
+			{
+				PARSER_CHECK_ERROR(PARSE_RESULT_UNDECLARED, "cannot reference '%s' before declaration\n",
+					symbol_text(expr->ident.sym));
+			}
+		}
+
+		if (expr->kind != EXPR_IDENT || !parser_try_parse_token(parser, TOK_EQ))
+		{
+			if (!declared)
+			{
+				*expr = expr_error_create(expr->location);
+			}
+			break;
+		}
+
+		if (sbcount(parser->pending_assignments) - base >= parser->max_expr_depth)
+		{
+			PARSER_ERROR("expression is nested more than %zu levels deep\n", parser->max_expr_depth);
+			return PARSE_RESULT_TOO_DEEP;
+		}
+		PendingAssignment pending = { .location = location, .name = expr->ident };
+		sbpush(parser->pending_assignments, pending);
+	}
+
+	for (size_t i = sbcount(parser->pending_assignments); i > base; i--)
+	{
+		Expr *value = malloc(sizeof(Expr));
+		*value = *expr;
+		PendingAssignment pending = parser->pending_assignments[i - 1];
+		*expr = expr_assignment_create(pending.location, pending.name, value);
+	}
+
+	return PARSE_RESULT_OK;
+}
+
+ParseResult parse_expression(Parser *parser, Expr *expr)
+{
+	size_t base = sbcount(parser->pending_assignments);
+	ParseResult res = parse_assignment_chain(parser, expr, base);
+	if (parser->pending_assignments != NULL)
+	{
+		stb__sbn(parser->pending_assignments) = base;
+	}
+	return res;
+}
+
+// the arguments of a call up to the closing parenthesis, checked against the parameters of `function` unless it is NULL
+ParseResult parse_call_args(Parser *parser, Function *function, Expr **args)
+{
+	size_t param_count = function != NULL ? sbcount(function->params) : 0;
+	while (!parser_try_parse_token(parser, TOK_RPAREN))
+	{
+		Expr arg;
+		TRY_PARSE(parse_expression(parser, &arg));
+		size_t index = sbcount(*args);
+		sbpush(*args, arg);
+
+		if (index < param_count)
+		{
+			Type ty;
+			if (!expr_infer_type(arg, parser->scope, &ty))
+			{
+				PARSER_CHECK_ERROR(PARSE_RESULT_COULD_NOT_INFER_EXPR_TYPE, "could not infer type of expression\n");
+			}
+			else if (!type_matches(ty, function->params[index].ty))
+			{
+				PARSER_CHECK_ERROR(PARSE_RESULT_UNEXPECTED_TOK, "type mismatch\n");
+			}
+		}
+
+		if (!parser_try_parse_token(parser, TOK_COMMA))
+		{
+			TRY_PARSE(parser_expect_token(parser, TOK_RPAREN));
+			break;
+		}
+	}
+
+	if (function != NULL && sbcount(*args) != param_count)
+	{
+		PARSER_CHECK_ERROR(PARSE_RESULT_WRONG_ARG_COUNT, "'%s' expects %zu argument%s, got %zu\n",
+			symbol_text(function->name.sym), param_count, param_count == 1 ? "" : "s", sbcount(*args));
+	}
+	return PARSE_RESULT_OK;
+}
+
+// $callee($expr, ...), with `expr` holding the callee. the arguments are checked against its parameters. if the
+// callee is not a function, the arguments are still checked on their own and the call becomes an error node
+ParseResult parse_call(Parser *parser, Location location, Expr *expr)
+{
+	Ident callee = expr->ident;
+	Decl decl;
+	bool callable = false;
+	if (!scope_get_value(parser->scope, callee.sym, &decl))
+	{
+		PARSER_CHECK_ERROR(PARSE_RESULT_UNDECLARED, "cannot reference '%s' before declaration\n",
+			symbol_text(callee.sym));
+	}
+	else
+	{
+		parser_index_name(parser, callee.sym, location.pos, &decl);
+		callable = decl.kind == DECL_FUNCTION;
+		if (!callable && decl.kind != DECL_ERROR)
+		{
+			PARSER_CHECK_ERROR(PARSE_RESULT_NOT_CALLABLE, "'%s' is not a function\n", symbol_text(callee.sym));
+		}
+	}
+	size_t max_call_depth = parser->max_expr_depth < MAX_CALL_DEPTH ? parser->max_expr_depth : MAX_CALL_DEPTH;
+	if (parser->call_depth >= max_call_depth)
+	{
+		PARSER_ERROR("calls are nested more than %zu levels deep\n", max_call_depth);
+		return PARSE_RESULT_TOO_DEEP;
+	}
+	TRY_PARSE(parser_expect_token(parser, TOK_LPAREN));
+
+	Expr *args = NULL;
+	parser->call_depth++;
+	ParseResult res = parse_call_args(parser, callable ? &decl.function : NULL, &args);
+	parser->call_depth--;
+	if (res != PARSE_RESULT_OK || !callable)
+	{
+		for (size_t i = 0; i < sbcount(args); i++)
+		{
+			expr_free(&args[i]);
+		}
+		sbfree(args);
+		*expr = expr_error_create(location);
+		return res;
+	}
+
+	*expr = expr_call_create(location, callee, args);
+	return PARSE_RESULT_OK;
+}
+
+ParseResult parse_identifier(Parser *parser, Ident *ident)
+{
+	// taken directly, since an identifier followed by a parenthesis would be a call expression
+	if (parser_try_parse_token(parser, TOK_IDENT))
+	{
+		ident->sym = parser->lexer->prev_token->sym;
+		return PARSE_RESULT_OK;
+	}
+
+	Expr expr;
+	TRY_PARSE(parse_identifier_or_literal(parser, &expr));
+	if (expr.kind == EXPR_IDENT)
+	{
+		*ident = expr.ident;
+		return PARSE_RESULT_OK;
+	}
+
+	PARSER_ERROR("expected identifier but got a literal?!\n");
+	return PARSE_RESULT_UNEXPECTED_TOK;
+}
+
+ParseResult parse_stmt(Parser *parser, Stmt *stmt);
+
+Hashmap *parser_find_import(Parser *parser, const char *specifier, bool *found)
+{
+	for (size_t i = 0; i < sbcount(parser->imports); i++)
+	{
+		if (strcmp(parser->imports[i].specifier, specifier) == 0)
+		{
+			*found = parser->imports[i].exports != NULL;
+			return parser->imports[i].exports;
+		}
+	}
+	*found = false;
+	return NULL;
+}
+
+// { $name, ... } from "$specifier". the buffers are filled in even if it fails, and the caller frees them
+ParseResult parse_import_clause(Parser *parser, Ident **names, size_t **name_ends)
+{
+	TRY_PARSE(parser_expect_token(parser, TOK_LBRACE));
+	while (!parser_try_parse_token(parser, TOK_RBRACE))
+	{
+		Ident name;
+		sbpush(*name_ends, parser->lexer->pos);
+		TRY_PARSE(parse_identifier(parser, &name));
+		sbpush(*names, name);
+
+		if (!parser_try_parse_token(parser, TOK_COMMA))
+		{
+			TRY_PARSE(parser_expect_token(parser, TOK_RBRACE));
+			break;
+		}
+	}
+
+	Ident from;
+	TRY_PARSE(parse_identifier(parser, &from));
+	if (strcmp(symbol_text(from.sym), "from") != 0)
+	{
+		PARSER_ERROR("expected 'from' but got '%s'\n", symbol_text(from.sym));
+		return PARSE_RESULT_UNEXPECTED_TOK;
+	}
+
+	return parser_expect_token(parser, TOK_STRING);
+}
+
+ParseResult parse_import(Parser *parser, Location location, Stmt *stmt)
+{
+	// import { $name, ... } from "$specifier";
+	Ident *names = NULL;
+	// stretchy buffer, where each name ends
+	size_t *name_ends = NULL;
+	ParseResult res = parse_import_clause(parser, &names, &name_ends);
+	if (res != PARSE_RESULT_OK)
+	{
+		sbfree(names);
+		sbfree(name_ends);
+		return res;
+	}
+	const char *specifier = parser->lexer->prev_token->text;
+
+	// names that cannot be imported are declared with DECL_ERROR, so that the rest of the module can still use them.
+	// scan_import_specifiers skips imports in function bodies, which have been reported already, so their modules
+	// were never loaded
+	bool found = false;
+	Hashmap *exports = NULL;
+	if (!parser->function.inside)
+	{
+		exports = parser_find_import(parser, specifier, &found);
+		if (!found)
+		{
+			PARSER_CHECK_ERROR(PARSE_RESULT_MODULE_NOT_FOUND, "cannot find module '%s'\n", specifier);
+		}
+	}
+
+	for (size_t i = 0; i < sbcount(names); i++)
+	{
+		if (scope_is_declared(parser->scope, names[i].sym))
+		{
+			PARSER_CHECK_ERROR(PARSE_RESULT_CANNOT_REDECLARE, "cannot redeclare symbol '%s'\n",
+				symbol_text(names[i].sym));
+			continue;
+		}
+		Decl decl = decl_error_create(location);
+		if (found && !hm_get(exports, names[i].sym, &decl))
+		{
+			PARSER_CHECK_ERROR(PARSE_RESULT_UNDECLARED, "module '%s' has no exported member '%s'\n", specifier,
+				symbol_text(names[i].sym));
+		}
+
+		// the import is what declares the name in this module
+		decl.location = location;
+		decl.name_pos = name_ends[i] - symbol_len(names[i].sym);
+		decl.exported = false;
+		scope_declare(parser->scope, names[i].sym, decl);
+		parser_index_name(parser, names[i].sym, name_ends[i], &decl);
+	}
+	sbfree(name_ends);
+
+	*stmt = stmt_import_create(location, names, specifier);
+	return PARSE_RESULT_OK;
+}
+
+// records an exported declaration with its type resolved, so that importers never need to look at this module's scope
+ParseResult parser_export_decl(Parser *parser, Decl *decl)
+{
+	decl->exported = true;
+
+	switch (decl->kind)
+	{
+	case DECL_LET:
+	{
+		Type ty = decl->let.ty;
+		if (!decl->let.typed)
+		{
+			PARSER_CHECK_ERROR(PARSE_RESULT_COULD_NOT_INFER_EXPR_TYPE, "could not infer type of exported binding '%s'\n",
+				symbol_text(decl->let.name.sym));
+			ty = TYPE_ERROR;
+		}
+		Decl exported = decl_resolved_let_create(decl->location, decl->let.name, ty);
+		hm_add(&parser->exports, decl->let.name.sym, exported);
+		return PARSE_RESULT_OK;
+	}
+	case DECL_TYPE_ALIAS:
+	{
+		// a target that cannot be resolved was reported when the alias was declared
+		Type ty;
+		if (!scope_resolve_type(parser->scope, decl->type_alias.type_name.sym, &ty))
+		{
+			ty = TYPE_ERROR;
+		}
+		Decl exported = decl_type_alias_create(decl->location, decl->type_alias.name,
+			(Ident){ .sym = intern_string(type_name(ty)) });
+		hm_add(&parser->exports, decl->type_alias.name.sym, exported);
+		return PARSE_RESULT_OK;
+	}
+	default:
+		UNREACHABLE("cannot export decl of kind '%d'\n", decl->kind);
+	}
+}
+
+// $type_name, which must resolve to a builtin type. if it doesn't, `ty` is TYPE_ERROR
+ParseResult parse_type_name(Parser *parser, Ident *type_name, Type *ty)
+{
+	size_t end = parser->lexer->pos;
+	TRY_PARSE(parse_identifier(parser, type_name));
+	if (!scope_resolve_type(parser->scope, type_name->sym, ty))
+	{
+		PARSER_CHECK_ERROR(PARSE_RESULT_UNDECLARED, "cannot reference type '%s' before declaration\n",
+			symbol_text(type_name->sym));
+		*ty = TYPE_ERROR;
+	}
+	else if (parser->index_spans)
+	{
+		Decl decl;
+		scope_get_value(parser->scope, type_name->sym, &decl);
+		parser_index_name(parser, type_name->sym, end, &decl);
+	}
+	return PARSE_RESULT_OK;
+}
+
+void parser_synchronize(Parser *parser, size_t start);
+
+// called once the statement at `location` has failed and its error has been reported. skips to the start of the next
+// statement and returns an error node in place of the failed one. if the statement was about to declare a name, the
+// name is declared with DECL_ERROR, so that the statements after it don't report it as undeclared
+Stmt parser_fail_stmt(Parser *parser, Location location, ParseResult res)
+{
+	parser_fail(parser, res);
+	parser_synchronize(parser, location.pos);
+	parser->has_errors = false;
+
+	if (parser->declaring)
+	{
+		Decl decl = decl_error_create(location);
+		decl.name_pos = parser->declaring_pos;
+		scope_declare(parser->scope, parser->declaring_name, decl);
+		parser->declaring = false;
+	}
+	return stmt_error_create(location);
+}
+
+// starts declaring `name`, see Parser.declaring
+void parser_begin_decl(Parser *parser, Symbol name, size_t end)
+{
+	parser->declaring = true;
+	parser->declaring_name = name;
+	parser->declaring_pos = end - symbol_len(name);
+}
+
+// { $stmt... }, up to but not including the closing brace. a statement that fails becomes an error node and is skipped
+// like at the top level. returns the first failure, which has already been reported and recorded
+ParseResult parse_function_body(Parser *parser, Stmt **body)
+{
+	ParseResult res = PARSE_RESULT_OK;
+	while (parser->lexer->token->kind != TOK_RBRACE && parser->lexer->token->kind != TOK_END_OF_FILE)
+	{
+		Location location = { .pos = parser->lexer->pos };
+		Stmt stmt;
+		ParseResult stmt_res = parse_stmt(parser, &stmt);
+		if (stmt_res != PARSE_RESULT_OK)
+		{
+			stmt = parser_fail_stmt(parser, location, stmt_res);
+			if (res == PARSE_RESULT_OK)
+			{
+				res = stmt_res;
+			}
+		}
+		sbpush(*body, stmt);
+	}
+	return res;
+}
+
+// ($param: $type_name, ...): $type_name. the buffers are filled in even if it fails, and the caller frees them
+ParseResult parse_signature(Parser *parser, Param **params, size_t **param_ends, Ident *return_type_name,
+	Type *return_ty)
+{
+	TRY_PARSE(parser_expect_token(parser, TOK_LPAREN));
+	while (!parser_try_parse_token(parser, TOK_RPAREN))
+	{
+		Param param;
+		sbpush(*param_ends, parser->lexer->pos);
+		TRY_PARSE(parse_identifier(parser, &param.name));
+		for (size_t i = 0; i < sbcount(*params); i++)
+		{
+			if ((*params)[i].name.sym == param.name.sym)
+			{
+				PARSER_CHECK_ERROR(PARSE_RESULT_CANNOT_REDECLARE, "duplicate parameter '%s'\n",
+					symbol_text(param.name.sym));
+				break;
+			}
+		}
+		TRY_PARSE(parser_expect_token(parser, TOK_COLON));
+		TRY_PARSE(parse_type_name(parser, &param.type_name, &param.ty));
+		sbpush(*params, param);
+
+		if (!parser_try_parse_token(parser, TOK_COMMA))
+		{
+			TRY_PARSE(parser_expect_token(parser, TOK_RPAREN));
+			break;
+		}
+	}
+
+	TRY_PARSE(parser_expect_token(parser, TOK_COLON));
+	return parse_type_name(parser, return_type_name, return_ty);
+}
+
+// the statement of a declared function owns its parameters, so they are freed along with it. if the statement goes
+// away first while the scope still refers to the signature, the parser takes them over until it is freed
+void parser_keep_params(Parser *parser, Stmt *stmt)
+{
+	sbpush(parser->kept_params, stmt->decl.function.params);
+	stmt->decl.function.params = NULL;
+}
+
+ParseResult parse_function(Parser *parser, Location location, Stmt *stmt)
+{
+	// function $name($param: $type_name, ...): $type_name { $stmt... }
+	Ident name;
+	size_t name_end = parser->lexer->pos;
+	TRY_PARSE(parse_identifier(parser, &name));
+	// a redeclared function is still checked, but the first declaration stays in the scope
+	bool redeclared = scope_is_declared_locally(parser->scope, name.sym);
+	if (redeclared)
+	{
+		PARSER_CHECK_ERROR(PARSE_RESULT_CANNOT_REDECLARE, "cannot redeclare symbol '%s'\n", symbol_text(name.sym));
+	}
+	else
+	{
+		parser_begin_decl(parser, name.sym, name_end);
+	}
+
+	Param *params = NULL;
+	// stretchy buffer, where each parameter name ends
+	size_t *param_ends = NULL;
+	Ident return_type_name;
+	Type return_ty;
+	ParseResult res = parse_signature(parser, &params, &param_ends, &return_type_name, &return_ty);
+	if (res != PARSE_RESULT_OK)
+	{
+		sbfree(params);
+		sbfree(param_ends);
+		return res;
+	}
+
+	// declared before the body so that the function can call itself
+	Decl decl = decl_function_create(location, name, params, return_type_name, return_ty);
+	decl.name_pos = name_end - symbol_len(name.sym);
+	if (!redeclared)
+	{
+		scope_declare(parser->scope, name.sym, decl);
+		parser->declaring = false;
+	}
+	parser_index_name(parser, name.sym, name_end, &decl);
+
+	*stmt = stmt_decl_create(location, decl);
+	res = parser_expect_token(parser, TOK_LBRACE);
+	if (res != PARSE_RESULT_OK)
+	{
+		sbfree(param_ends);
+		if (!redeclared)
+		{
+			parser_keep_params(parser, stmt);
+		}
+		stmt_free(stmt);
+		return res;
+	}
+
+	Scope *outer_scope = parser->scope;
+	FunctionContext outer_function = parser->function;
+	parser->scope = scope_pool_acquire(&parser->scope_pool, outer_scope);
+	parser->function = (FunctionContext){ .inside = true, .return_ty = return_ty, .returned = false };
+	for (size_t i = 0; i < sbcount(params); i++)
+	{
+		Decl param = decl_resolved_let_create(location, params[i].name, params[i].ty);
+		param.name_pos = param_ends[i] - symbol_len(params[i].name.sym);
+		scope_declare(parser->scope, params[i].name.sym, param);
+		parser_index_name(parser, params[i].name.sym, param_ends[i], &param);
+	}
+	sbfree(param_ends);
+
+	// a statement that failed may have been the return
+	res = parse_function_body(parser, &stmt->decl.function.body);
+	if (res == PARSE_RESULT_OK && !parser->function.returned && return_ty.id != TYPE_ERROR.id)
+	{
+		PARSER_CHECK_ERROR(PARSE_RESULT_MISSING_RETURN, "function '%s' must return a value of type '%s'\n",
+			symbol_text(name.sym), type_name(return_ty));
+	}
+
+	scope_pool_release(&parser->scope_pool, parser->scope);
+	parser->scope = outer_scope;
+	parser->function = outer_function;
+
+	res = parser_expect_token(parser, TOK_RBRACE);
+	// a streaming parser frees a module-level statement as soon as it is checked
+	if (!redeclared && (res != PARSE_RESULT_OK || (parser->stream && !parser->function.inside)))
+	{
+		parser_keep_params(parser, stmt);
+	}
+	if (res != PARSE_RESULT_OK)
+	{
+		stmt_free(stmt);
+	}
+	return res;
+}
+
+ParseResult parse_stmt(Parser *parser, Stmt *stmt)
+{
+	size_t pos = parser->lexer->pos;
+	Location location = { .pos = pos };
+
+	if (parser_try_parse_token(parser, TOK_EXPORT))
+	{
+		// export let ...; or export type ...;
+		TokenKind kind = parser->lexer->token->kind;
+		if (kind != TOK_LET && kind != TOK_TYPE)
+		{
+			PARSER_ERROR("expected a let or type declaration after export, got %s\n", token_kind_name(kind));
+			return PARSE_RESULT_UNEXPECTED_TOK;
+		}
+		// a declaration in a function body is still checked, but only as a local one
+		bool top_level = !parser->function.inside;
+		if (!top_level)
+		{
+			PARSER_CHECK_ERROR(PARSE_RESULT_UNEXPECTED_TOK, "cannot export from inside a function\n");
+		}
+		TRY_PARSE(parse_stmt(parser, stmt));
+		return top_level ? parser_export_decl(parser, &stmt->decl) : PARSE_RESULT_OK;
+	}
+
+	if (parser_try_parse_token(parser, TOK_FUNCTION))
+	{
+		// the body ends the statement, there is no semicolon
+		return parse_function(parser, location, stmt);
+	}
+
+	if (parser_try_parse_token(parser, TOK_IMPORT))
+	{
+		if (parser->function.inside)
+		{
+			PARSER_CHECK_ERROR(PARSE_RESULT_UNEXPECTED_TOK, "cannot import from inside a function\n");
+		}
+		TRY_PARSE(parse_import(parser, location, stmt));
+	}
+	else if (parser_try_parse_token(parser, TOK_RETURN))
+	{
+		// return $expr;
+		if (!parser->function.inside)
+		{
+			PARSER_CHECK_ERROR(PARSE_RESULT_UNEXPECTED_TOK, "cannot return outside of a function\n");
+		}
+		parser->function.returned = true;
+
+		Expr expr;
+		TRY_PARSE(parse_expression(parser, &expr));
+		// outside of a function there is no return type to check against
+		Type ty;
+		if (parser->function.inside && !expr_infer_type(expr, parser->scope, &ty))
+		{
+			PARSER_CHECK_ERROR(PARSE_RESULT_COULD_NOT_INFER_EXPR_TYPE, "could not infer type of expression\n");
+		}
+		else if (parser->function.inside && !type_matches(ty, parser->function.return_ty))
+		{
+			PARSER_CHECK_ERROR(PARSE_RESULT_UNEXPECTED_TOK, "type mismatch\n");
+		}
+		*stmt = stmt_return_create(location, expr);
+	}
+	else if (parser_try_parse_token(parser, TOK_LET))
+	{
+		// let $name: $type_name = $expr;
+		Ident name;
+		size_t name_end = parser->lexer->pos;
+		TRY_PARSE(parse_identifier(parser, &name));
+
+		// a redeclared binding is still checked, but the first declaration stays in the scope
+		bool redeclared = scope_is_declared_locally(parser->scope, name.sym);
+		if (redeclared)
+		{
+			PARSER_CHECK_ERROR(PARSE_RESULT_CANNOT_REDECLARE, "cannot redeclare symbol '%s'\n", symbol_text(name.sym));
+		}
+		else
+		{
+			parser_begin_decl(parser, name.sym, name_end);
+		}
+
+		// the annotation is only copied to the heap once the rest of the statement has parsed, so a failure doesn't leak it
+		Ident type_ident;
+		Type named_ty = TYPE_ERROR;
+		bool annotated = parser_try_parse_token(parser, TOK_COLON);
+		if (annotated)
+		{
+			size_t type_name_end = parser->lexer->pos;
+			TRY_PARSE(parse_identifier(parser, &type_ident));
+
+			Decl type_name_decl;
+			if (!scope_get_value(parser->scope, type_ident.sym, &type_name_decl))
+			{
+				PARSER_CHECK_ERROR(PARSE_RESULT_UNDECLARED, "cannot reference type '%s' before declaration\n",
+					symbol_text(type_ident.sym));
+			}
+			else if (type_name_decl.kind != DECL_TYPE_ALIAS && type_name_decl.kind != DECL_ERROR)
+			{
+				PARSER_CHECK_ERROR(PARSE_RESULT_X, "omg what have you done\n");
+			}
+			else if (!scope_resolve_type(parser->scope, type_ident.sym, &named_ty))
+			{
+				PARSER_CHECK_ERROR(PARSE_RESULT_UNDECLARED, "cannot resolve type '%s'\n", symbol_text(type_ident.sym));
+				named_ty = TYPE_ERROR;
+			}
+			else
+			{
+				parser_index_name(parser, type_ident.sym, type_name_end, &type_name_decl);
+			}
+		}
+
+		TRY_PARSE(parser_expect_token(parser, TOK_EQ));
+
+		Expr init;
+		TRY_PARSE(parse_expression(parser, &init));
+
+		Type ty = { 0 };
+		bool typed = expr_infer_type(init, parser->scope, &ty);
+		if (annotated)
+		{
+			// if the decl includes a kind, check that the kind of the expr matches the stated kind
+			if (!typed)
+			{
+				PARSER_CHECK_ERROR(PARSE_RESULT_COULD_NOT_INFER_EXPR_TYPE, "could not infer type of expression\n");
+			}
+			else if (!type_matches(ty, named_ty))
+			{
+				PARSER_CHECK_ERROR(PARSE_RESULT_UNEXPECTED_TOK, "type mismatch\n");
+			}
+			// uses of the binding are checked against the stated kind, even if the initializer doesn't match it
+			typed = true;
+			ty = named_ty;
+		}
+
+		Ident *type_name = NULL;
+		if (annotated)
+		{
+			type_name = malloc(sizeof(Ident));
+			*type_name = type_ident;
+		}
+		Decl decl = decl_let_create(location, name, type_name, init);
+		decl.let.typed = typed;
+		decl.let.ty = ty;
+		decl.name_pos = name_end - symbol_len(name.sym);
+		*stmt = stmt_decl_create(location, decl);
+
+		if (!redeclared)
+		{
+			scope_declare(parser->scope, name.sym, decl);
+			parser->declaring = false;
+		}
+		parser_index_name(parser, name.sym, name_end, &decl);
+	}
+	else if (parser_try_parse_token(parser, TOK_TYPE))
+	{
+		// type $name = $type_name;
+		Ident name;
+		size_t name_end = parser->lexer->pos;
+		TRY_PARSE(parse_identifier(parser, &name));
+
+		bool redeclared = scope_is_declared_locally(parser->scope, name.sym);
+		if (redeclared)
+		{
+			PARSER_CHECK_ERROR(PARSE_RESULT_CANNOT_REDECLARE, "cannot redeclare symbol '%s'\n", symbol_text(name.sym));
+		}
+		else
+		{
+			parser_begin_decl(parser, name.sym, name_end);
+		}
+
+		TRY_PARSE(parser_expect_token(parser, TOK_EQ));
+
+		Ident type_name;
+		Type ty;
+		TRY_PARSE(parse_type_name(parser, &type_name, &ty));
+
+		Decl decl = decl_type_alias_create(location, name, type_name);
+		decl.name_pos = name_end - symbol_len(name.sym);
+		*stmt = stmt_decl_create(location, decl);
+
+		// an alias of a type that could not be resolved is an error wherever it is used
+		Decl declared = decl;
+		if (ty.id == TYPE_ERROR.id)
+		{
+			declared = decl_error_create(location);
+			declared.name_pos = decl.name_pos;
+		}
+		if (!redeclared)
+		{
+			scope_declare(parser->scope, name.sym, declared);
+			parser->declaring = false;
+		}
+		parser_index_name(parser, name.sym, name_end, &declared);
+	}
+	else
+	{
+		// $expr;
+		Expr expr;
+		TRY_PARSE(parse_expression(parser, &expr));
+		*stmt = stmt_expr_create(location, expr);
+	}
+
+	TRY_PARSE(parser_expect_token(parser, TOK_SEMICOLON));
+	return PARSE_RESULT_OK;
+}
+
+// skips to the start of the next statement after the one that started at `start` failed. the token it failed on may
+// already start the next statement, e.g. when a semicolon is missing, so it is only skipped if the statement consumed
+// nothing, which would otherwise fail on it over and over
+void parser_synchronize(Parser *parser, size_t start)
+{
+	if (parser->lexer->pos == start)
+	{
+		lexer_scan(parser->lexer);
+	}
+
+	while (parser->lexer->token->kind != TOK_END_OF_FILE)
+	{
+		Token *prev_token = parser->lexer->prev_token;
+		if (prev_token != NULL && prev_token->kind == TOK_SEMICOLON)
+		{
+			return;
+		}
+
+		switch (parser->lexer->token->kind)
+		{
+		case TOK_LET:
+		case TOK_FUNCTION:
+		case TOK_TYPE:
+		case TOK_RETURN:
+		case TOK_IMPORT:
+		case TOK_EXPORT:
+			return;
+		case TOK_RBRACE:
+			// the end of a function body. outside of one, it can only be skipped
+			if (parser->function.inside)
+			{
+				return;
+			}
+			break;
+		default:
+			break;
+		}
+
+		lexer_scan(parser->lexer);
+	}
+}
+
+void expr_free(Expr *expr)
+{
+	bool boxed = false;
+	while (expr->kind == EXPR_ASSIGNMENT)
+	{
+		Expr *value = expr->assignment.expr;
+		if (boxed)
+		{
+			free(expr);
+		}
+		expr = value;
+		boxed = true;
+	}
+
+	if (expr->kind == EXPR_CALL)
+	{
+		for (size_t i = 0; i < sbcount(expr->call.args); i++)
+		{
+			expr_free(&expr->call.args[i]);
+		}
+		sbfree(expr->call.args);
+	}
+	if (boxed)
+	{
+		free(expr);
+	}
+}
+
+// frees everything a checked statement owns. names are interned, so they are never freed
+void stmt_free(Stmt *stmt)
+{
+	switch (stmt->kind)
+	{
+	case STMT_EXPR:
+	case STMT_RETURN:
+		expr_free(&stmt->expr);
+		break;
+	case STMT_DECL:
+	{
+		Decl *decl = &stmt->decl;
+		if (decl->kind == DECL_LET)
+		{
+			free(decl->let.type_name);
+			expr_free(&decl->let.init);
+		}
+		else if (decl->kind == DECL_FUNCTION)
+		{
+			for (size_t i = 0; i < sbcount(decl->function.body); i++)
+			{
+				stmt_free(&decl->function.body[i]);
+			}
+			sbfree(decl->function.body);
+			sbfree(decl->function.params);
+		}
+		break;
+	}
+	case STMT_IMPORT:
+		free((char *)stmt->import.specifier);
+		sbfree(stmt->import.names);
+		break;
+	case STMT_ERROR:
+		break;
+	default:
+		UNREACHABLE("unexpected stmt of kind '%d'\n", stmt->kind);
+	}
+}
+
+ParseResult parser_parse_module(Parser *parser, Module *mod)
+{
+	lexer_scan(parser->lexer);
+	if (parser_try_parse_token(parser, TOK_END_OF_FILE))
+	{
+		return PARSE_RESULT_OK;
+	}
+
+	// module-level scope
+	Scope scope;
+	scope_init(&scope, NULL);
+	if (parser->stream)
+	{
+		scope_make_compact(parser->scope);
+	}
+
+	while (true)
+	{
+		Location location = { .pos = parser->lexer->pos };
+		Stmt stmt;
+		ParseResult res = parse_stmt(parser, &stmt);
+		if (res != PARSE_RESULT_OK)
+		{
+			// a statement that failed to parse is left partly uninitialized, so it is replaced by an error node
+			stmt = parser_fail_stmt(parser, location, res);
+		}
+
+		if (parser->stream)
+		{
+			stmt_free(&stmt);
+			lexer_release_consumed(parser->lexer);
+		}
+		else
+		{
+			sbpush(mod->statements, stmt);
+		}
+
+		if (parser_try_parse_token(parser, TOK_END_OF_FILE))
+		{
+			break;
+		}
+	}
+
+	// checking carries on after errors, so this is the first error rather than that of the last statement
+	return parser->result;
+}
+
+ParseResult parser_parse(Parser *parser, Module *module)
+{
+	return parser_parse_module(parser, module);
+}
+
+int span_compare(const void *a, const void *b)
+{
+	const Span *x = a;
+	const Span *y = b;
+	return (x->start > y->start) - (x->start < y->start);
+}
+
+// the spans of declared names are recorded after their initializers, so they are sorted by position once the module
+// has been checked. identifiers never overlap, so afterwards the ends are sorted too
+void span_index_sort(Span *spans)
+{
+	if (spans != NULL)
+	{
+		qsort(spans, sbcount(spans), sizeof(Span), span_compare);
+	}
+}
+
+// the index of the first span in [lo, sbcount(spans)) that ends after `pos`
+size_t span_index_search(Span *spans, size_t lo, size_t pos)
+{
+	size_t hi = sbcount(spans);
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if (spans[mid].end <= pos)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+// the identifier at byte offset `pos`, or NULL if there is none
+Span *span_index_find(Span *spans, size_t pos)
+{
+	size_t i = span_index_search(spans, 0, pos);
+	return i < sbcount(spans) && spans[i].start <= pos ? &spans[i] : NULL;
+}
+
+// looks up `count` positions at once. while the positions ascend, each search starts where the previous one ended, so
+// a sorted batch costs O(count log(n / count)) rather than O(count log n)
+void span_index_find_all(Span *spans, const size_t *positions, size_t count, Span **found)
+{
+	size_t lo = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (i > 0 && positions[i] < positions[i - 1])
+		{
+			lo = 0;
+		}
+		lo = span_index_search(spans, lo, positions[i]);
+		found[i] = lo < sbcount(spans) && spans[lo].start <= positions[i] ? &spans[lo] : NULL;
+	}
+}
+
+// a top-level statement found by the structural pass of a query: where it starts, the names it declares and the
+// names it refers to
+typedef struct
+{
+	size_t start;
+	Symbol *declares;
+	Symbol *references;
+	bool needed;
+} QueryStmt;
+
+typedef struct
+{
+	Symbol name;
+	size_t stmt;
+} QueryName;
+
+// orders by symbol rather than by text, which is all the lookups below need
+int query_name_compare(const void *a, const void *b)
+{
+	const QueryName *x = a;
+	const QueryName *y = b;
+	if (x->name != y->name)
+	{
+		return x->name < y->name ? -1 : 1;
+	}
+	return x->stmt < y->stmt ? -1 : x->stmt > y->stmt;
+}
+
+// finds the statement that declares `name`, i.e. the first one to do so since later ones are redeclaration errors.
+// returns SIZE_MAX if there is none
+size_t query_find_decl(QueryName *names, size_t count, Symbol name)
+{
+	size_t lo = 0;
+	size_t hi = count;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if (names[mid].name < name)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return lo < count && names[lo].name == name ? names[lo].stmt : SIZE_MAX;
+}
+
+// records the span and names of every top-level statement without parsing or checking anything. the first identifier
+// after let, type or function is declared, the identifiers between the braces of an import are declared, and every
+// other identifier is a reference. that includes parameters and locals of a function, which at worst makes a
+// declaration needed that isn't
+QueryStmt *query_scan_stmts(Lexer *lexer)
+{
+	QueryStmt *stmts = NULL;
+	while (true)
+	{
+		// a statement starts right after the previous one, the lexer skips the whitespace in between
+		QueryStmt stmt = { .start = lexer->pos };
+		lexer_scan(lexer);
+		if (lexer->token->kind == TOK_END_OF_FILE)
+		{
+			break;
+		}
+
+		TokenKind first = lexer->token->kind;
+		if (first == TOK_EXPORT)
+		{
+			lexer_scan(lexer);
+			first = lexer->token->kind;
+		}
+		bool declaring = first == TOK_LET || first == TOK_TYPE || first == TOK_FUNCTION;
+		bool importing = first == TOK_IMPORT;
+
+		// the statements of a function body are part of the function, whose own end is its closing brace
+		int depth = 0;
+		while (lexer->token->kind != TOK_END_OF_FILE && !(lexer->token->kind == TOK_SEMICOLON && depth == 0))
+		{
+			if (lexer->token->kind == TOK_LBRACE)
+			{
+				depth++;
+			}
+			else if (lexer->token->kind == TOK_RBRACE)
+			{
+				importing = false;
+				if (--depth == 0 && first == TOK_FUNCTION)
+				{
+					break;
+				}
+			}
+			else if (lexer->token->kind == TOK_IDENT)
+			{
+				if (declaring || importing)
+				{
+					sbpush(stmt.declares, lexer->token->sym);
+					declaring = false;
+				}
+				else if (first != TOK_IMPORT)
+				{
+					sbpush(stmt.references, lexer->token->sym);
+				}
+			}
+			lexer_scan(lexer);
+		}
+		sbpush(stmts, stmt);
+	}
+	return stmts;
+}
+
+// checks only the statements that the declarations of `roots` transitively depend on, in source order, and writes the
+// type of each root to `answers`. the statements are found by a structural pass, and the lexer is moved to each needed
+// statement in turn, so the rest of the module is never checked
+ParseResult parser_parse_query(Parser *parser, char **roots, FILE *answers)
+{
+	QueryStmt *stmts = query_scan_stmts(parser->lexer);
+
+	QueryName *names = NULL;
+	for (size_t i = 0; i < sbcount(stmts); i++)
+	{
+		for (size_t j = 0; j < sbcount(stmts[i].declares); j++)
+		{
+			QueryName name = { .name = stmts[i].declares[j], .stmt = i };
+			sbpush(names, name);
+		}
+	}
+	size_t name_count = sbcount(names);
+	if (name_count > 0)
+	{
+		qsort(names, name_count, sizeof(QueryName), query_name_compare);
+	}
+
+	size_t *worklist = NULL;
+	for (size_t i = 0; i < sbcount(roots); i++)
+	{
+		size_t stmt = query_find_decl(names, name_count, intern_string(roots[i]));
+		if (stmt != SIZE_MAX && !stmts[stmt].needed)
+		{
+			stmts[stmt].needed = true;
+			sbpush(worklist, stmt);
+		}
+	}
+	while (sbcount(worklist) > 0)
+	{
+		QueryStmt *stmt = &stmts[worklist[--stb__sbn(worklist)]];
+		for (size_t i = 0; i < sbcount(stmt->references); i++)
+		{
+			// builtin types and undeclared names have no statement. the latter are reported when the statement
+			// referring to them is checked
+			size_t dep = query_find_decl(names, name_count, stmt->references[i]);
+			if (dep != SIZE_MAX && !stmts[dep].needed)
+			{
+				stmts[dep].needed = true;
+				sbpush(worklist, dep);
+			}
+		}
+	}
+
+	for (size_t i = 0; i < sbcount(stmts); i++)
+	{
+		if (!stmts[i].needed)
+		{
+			continue;
+		}
+
+		lexer_seek(parser->lexer, stmts[i].start);
+		lexer_scan(parser->lexer);
+		Location location = { .pos = parser->lexer->pos };
+		Stmt stmt;
+		ParseResult stmt_res = parse_stmt(parser, &stmt);
+		if (stmt_res != PARSE_RESULT_OK)
+		{
+			// the next statement is found by its span, so where parser_fail_stmt synchronized to doesn't matter
+			parser_fail_stmt(parser, location, stmt_res);
+		}
+	}
+	ParseResult res = parser->result;
+
+	for (size_t i = 0; i < sbcount(roots); i++)
+	{
+		Decl decl;
+		Type ty;
+		Symbol root = intern_string(roots[i]);
+		if (!scope_get_value(parser->scope, root, &decl))
+		{
+			fprintf(answers, "%s: not declared\n", roots[i]);
+			if (res == PARSE_RESULT_OK)
+			{
+				res = PARSE_RESULT_UNDECLARED;
+			}
+		}
+		else if (decl.kind == DECL_TYPE_ALIAS && scope_resolve_type(parser->scope, root, &ty))
+		{
+			fprintf(answers, "type %s = %s\n", roots[i], type_name(ty));
+		}
+		else if (decl.kind == DECL_RESOLVED_LET)
+		{
+			fprintf(answers, "%s: %s\n", roots[i], type_name(decl.resolved_let.ty));
+		}
+		else if (decl.kind == DECL_LET && decl.let.typed)
+		{
+			fprintf(answers, "%s: %s\n", roots[i], type_name(decl.let.ty));
+		}
+		else if (decl.kind == DECL_FUNCTION)
+		{
+			fprintf(answers, "%s: (", roots[i]);
+			for (size_t j = 0; j < sbcount(decl.function.params); j++)
+			{
+				Param *param = &decl.function.params[j];
+				fprintf(answers, "%s%s: %s", j > 0 ? ", " : "", symbol_text(param->name.sym), type_name(param->ty));
+			}
+			fprintf(answers, ") => %s\n", type_name(decl.function.return_ty));
+		}
+		else
+		{
+			fprintf(answers, "%s: unknown\n", roots[i]);
+		}
+	}
+
+	for (size_t i = 0; i < sbcount(stmts); i++)
+	{
+		sbfree(stmts[i].declares);
+		sbfree(stmts[i].references);
+	}
+	sbfree(stmts);
+	sbfree(names);
+	sbfree(worklist);
+	return res;
+}
+
+#define AST_MAGIC "SPTA"
+#define AST_VERSION 3
+#define AST_NONE UINT32_MAX
+
+// an on-disk copy of a Module that can be walked straight from an mmap. nodes live in flat arrays and refer to each
+// other by index, and all text lives in one blob of NUL terminated strings that nodes refer to by offset. the file is
+// laid out as the header, then the statements, the expressions, the name list, the argument list, and finally the
+// strings. expressions are written children first, so an expression always refers to expressions with a lower index.
+// the statements of the module come first, and function bodies after them, so a function always refers to
+// statements with a higher index
+typedef struct
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t stmt_count;
+	// the first module_stmt_count statements are the ones of the module
+	uint32_t module_stmt_count;
+	uint32_t expr_count;
+	uint32_t name_count;
+	uint32_t arg_count;
+	uint32_t strings_size;
+} AstHeader;
+
+typedef struct
+{
+	uint64_t pos;
+	// EXPR_NUM
+	double number;
+	// ExprKind
+	uint32_t kind;
+	// EXPR_IDENT and EXPR_ASSIGNMENT: string offset of the identifier. EXPR_CALL: string offset of the callee
+	uint32_t name;
+	// EXPR_ASSIGNMENT: index of the assigned expression. EXPR_BOOL: 0 or 1. EXPR_CALL: the arguments are entries
+	// [value, value + count) of the argument list
+	uint32_t value;
+	uint32_t count;
+} AstExpr;
+
+typedef struct
+{
+	uint64_t pos;
+	uint64_t decl_pos;
+	// StmtKind
+	uint32_t kind;
+	// STMT_DECL: DeclKind
+	uint32_t decl_kind;
+	// STMT_DECL: 0 or 1
+	uint32_t exported;
+	// STMT_DECL: string offset of the declared name
+	uint32_t name;
+	// DECL_LET: string offset of the annotated type or AST_NONE. DECL_TYPE_ALIAS: string offset of the aliased type.
+	// DECL_FUNCTION: string offset of the return type
+	uint32_t type_name;
+	// STMT_EXPR and STMT_RETURN: the expression. DECL_LET: the initializer
+	uint32_t expr;
+	// STMT_IMPORT: the imported names are entries [first_name, first_name + name_count) of the name list.
+	// DECL_FUNCTION: the name and then the type of each parameter are
+	uint32_t first_name;
+	uint32_t name_count;
+	// STMT_IMPORT: string offset of the module specifier
+	uint32_t specifier;
+	// DECL_FUNCTION: the body is statements [first_stmt, first_stmt + stmt_count)
+	uint32_t first_stmt;
+	uint32_t stmt_count;
+	uint32_t reserved;
+} AstStmt;
+
+const AstStmt *ast_stmts(const AstHeader *header)
+{
+	return (const AstStmt *)(header + 1);
+}
+
+const AstExpr *ast_exprs(const AstHeader *header)
+{
+	return (const AstExpr *)(ast_stmts(header) + header->stmt_count);
+}
+
+// string offsets of imported names and of parameters
+const uint32_t *ast_names(const AstHeader *header)
+{
+	return (const uint32_t *)(ast_exprs(header) + header->expr_count);
+}
+
+// expression indices of call arguments
+const uint32_t *ast_args(const AstHeader *header)
+{
+	return ast_names(header) + header->name_count;
+}
+
+const char *ast_strings(const AstHeader *header)
+{
+	return (const char *)(ast_args(header) + header->arg_count);
+}
+
+typedef struct
+{
+	AstStmt *stmts;
+	// the statement each node was written from, so that function bodies can be appended after the module
+	Stmt **sources;
+	AstExpr *exprs;
+	uint32_t *names;
+	uint32_t *args;
+	char *strings;
+} AstWriter;
+
+uint32_t ast_add_string(AstWriter *w, const char *s)
+{
+	size_t len = strlen(s) + 1;
+	uint32_t offset = sbcount(w->strings);
+	memcpy(sbadd(w->strings, len), s, len);
+	return offset;
+}
+
+uint32_t ast_add_expr(AstWriter *w, Expr *expr)
+{
+	// an assignment chain is written innermost first, walking it with a loop rather than recursion
+	Expr **chain = NULL;
+	while (expr->kind == EXPR_ASSIGNMENT)
+	{
+		sbpush(chain, expr);
+		expr = expr->assignment.expr;
+	}
+
+	AstExpr node = { .pos = expr->location.pos, .kind = expr->kind, .name = AST_NONE, .value = 0 };
+	switch (expr->kind)
+	{
+	case EXPR_IDENT:
+		node.name = ast_add_string(w, symbol_text(expr->ident.sym));
+		break;
+	case EXPR_NUM:
+		node.number = expr->num.value;
+		break;
+	case EXPR_BOOL:
+		node.value = expr->boolean;
+		break;
+	case EXPR_ERROR:
+		break;
+	case EXPR_CALL:
+	{
+		// calls nest no deeper than MAX_CALL_DEPTH, so their arguments can be written recursively
+		uint32_t *args = NULL;
+		for (size_t i = 0; i < sbcount(expr->call.args); i++)
+		{
+			sbpush(args, ast_add_expr(w, &expr->call.args[i]));
+		}
+		node.name = ast_add_string(w, symbol_text(expr->call.callee.sym));
+		node.value = sbcount(w->args);
+		node.count = sbcount(args);
+		for (size_t i = 0; i < sbcount(args); i++)
+		{
+			sbpush(w->args, args[i]);
+		}
+		sbfree(args);
+		break;
+	}
+	default:
+		UNREACHABLE("unexpected expr of kind '%d'\n", expr->kind);
+	}
+	sbpush(w->exprs, node);
+
+	for (size_t i = sbcount(chain); i > 0; i--)
+	{
+		AstExpr assignment = {
+			.pos = chain[i - 1]->location.pos,
+			.kind = EXPR_ASSIGNMENT,
+			.name = ast_add_string(w, symbol_text(chain[i - 1]->assignment.name.sym)),
+			.value = sbcount(w->exprs) - 1,
+		};
+		sbpush(w->exprs, assignment);
+	}
+	sbfree(chain);
+
+	return sbcount(w->exprs) - 1;
+}
+
+void ast_add_stmt(AstWriter *w, Stmt *stmt)
+{
+	AstStmt node = {
+		.pos = stmt->location.pos,
+		.kind = stmt->kind,
+		.name = AST_NONE,
+		.type_name = AST_NONE,
+		.expr = AST_NONE,
+		.first_name = AST_NONE,
+		.specifier = AST_NONE,
+		.first_stmt = AST_NONE,
+	};
+
+	switch (stmt->kind)
+	{
+	case STMT_EXPR:
+	case STMT_RETURN:
+		node.expr = ast_add_expr(w, &stmt->expr);
+		break;
+	case STMT_DECL:
+	{
+		Decl *decl = &stmt->decl;
+		node.decl_pos = decl->location.pos;
+		node.decl_kind = decl->kind;
+		node.exported = decl->exported;
+		if (decl->kind == DECL_LET)
+		{
+			node.name = ast_add_string(w, symbol_text(decl->let.name.sym));
+			if (decl->let.type_name != NULL)
+			{
+				node.type_name = ast_add_string(w, symbol_text(decl->let.type_name->sym));
+			}
+			node.expr = ast_add_expr(w, &decl->let.init);
+		}
+		else if (decl->kind == DECL_TYPE_ALIAS)
+		{
+			node.name = ast_add_string(w, symbol_text(decl->type_alias.name.sym));
+			node.type_name = ast_add_string(w, symbol_text(decl->type_alias.type_name.sym));
+		}
+		else if (decl->kind == DECL_FUNCTION)
+		{
+			// the body is written by ast_write once the statements before it are
+			node.name = ast_add_string(w, symbol_text(decl->function.name.sym));
+			node.type_name = ast_add_string(w, symbol_text(decl->function.return_type_name.sym));
+			node.first_name = sbcount(w->names);
+			node.name_count = 2 * sbcount(decl->function.params);
+			for (size_t i = 0; i < sbcount(decl->function.params); i++)
+			{
+				sbpush(w->names, ast_add_string(w, symbol_text(decl->function.params[i].name.sym)));
+				sbpush(w->names, ast_add_string(w, symbol_text(decl->function.params[i].type_name.sym)));
+			}
+		}
+		else
+		{
+			UNREACHABLE("unexpected decl of kind '%d' in a module\n", decl->kind);
+		}
+		break;
+	}
+	case STMT_IMPORT:
+		node.specifier = ast_add_string(w, stmt->import.specifier);
+		node.first_name = sbcount(w->names);
+		node.name_count = sbcount(stmt->import.names);
+		for (size_t i = 0; i < sbcount(stmt->import.names); i++)
+		{
+			sbpush(w->names, ast_add_string(w, symbol_text(stmt->import.names[i].sym)));
+		}
+		break;
+	case STMT_ERROR:
+		break;
+	default:
+		UNREACHABLE("unexpected stmt of kind '%d'\n", stmt->kind);
+	}
+
+	sbpush(w->stmts, node);
+	sbpush(w->sources, stmt);
+}
+
+// every count, index and offset in the file is 32 bits. an offset is always below the count or size it indexes into,
+// so checking the totals is enough to know that nothing written into a node was truncated
+bool ast_count_fits(const char *what, size_t count)
+{
+	if (count > UINT32_MAX)
+	{
+		fprintf(stderr, "AST has %zu %s, more than the %" PRIu32 " the format can hold\n", count, what, UINT32_MAX);
+		return false;
+	}
+	return true;
+}
+
+// an empty section is a NULL stretchy buffer, which must not be passed to fwrite even with a count of 0
+bool ast_write_section(FILE *f, const void *items, size_t size, size_t count)
+{
+	return count == 0 || fwrite(items, size, count, f) == count;
+}
+
+bool ast_write(Module *mod, FILE *f)
+{
+	AstWriter w = { .stmts = NULL, .sources = NULL, .exprs = NULL, .names = NULL, .args = NULL, .strings = NULL };
+	for (size_t i = 0; i < sbcount(mod->statements); i++)
+	{
+		ast_add_stmt(&w, &mod->statements[i]);
+	}
+	// function bodies are appended behind everything written so far, which includes bodies that are appended while
+	// walking, so nested functions need no recursion
+	for (size_t i = 0; i < sbcount(w.stmts); i++)
+	{
+		Stmt *stmt = w.sources[i];
+		if (stmt->kind != STMT_DECL || stmt->decl.kind != DECL_FUNCTION)
+		{
+			continue;
+		}
+		Stmt *body = stmt->decl.function.body;
+		w.stmts[i].first_stmt = sbcount(w.stmts);
+		w.stmts[i].stmt_count = sbcount(body);
+		for (size_t j = 0; j < sbcount(body); j++)
+		{
+			ast_add_stmt(&w, &body[j]);
+		}
+	}
+
+	bool ok = ast_count_fits("statements", sbcount(w.stmts)) && ast_count_fits("expressions", sbcount(w.exprs)) &&
+		ast_count_fits("names", sbcount(w.names)) && ast_count_fits("arguments", sbcount(w.args)) &&
+		ast_count_fits("bytes of strings", sbcount(w.strings));
+
+	AstHeader header = {
+		.version = AST_VERSION,
+		.stmt_count = sbcount(w.stmts),
+		.module_stmt_count = sbcount(mod->statements),
+		.expr_count = sbcount(w.exprs),
+		.name_count = sbcount(w.names),
+		.arg_count = sbcount(w.args),
+		.strings_size = sbcount(w.strings),
+	};
+	memcpy(header.magic, AST_MAGIC, sizeof(header.magic));
+
+	ok = ok && fwrite(&header, sizeof(header), 1, f) == 1;
+	ok = ok && ast_write_section(f, w.stmts, sizeof(AstStmt), header.stmt_count);
+	ok = ok && ast_write_section(f, w.exprs, sizeof(AstExpr), header.expr_count);
+	ok = ok && ast_write_section(f, w.names, sizeof(uint32_t), header.name_count);
+	ok = ok && ast_write_section(f, w.args, sizeof(uint32_t), header.arg_count);
+	ok = ok && ast_write_section(f, w.strings, 1, header.strings_size);
+	ok = fflush(f) == 0 && ok;
+
+	sbfree(w.stmts);
+	sbfree(w.sources);
+	sbfree(w.exprs);
+	sbfree(w.names);
+	sbfree(w.args);
+	sbfree(w.strings);
+	return ok;
+}
+
+bool ast_string_is_valid(const AstHeader *header, uint32_t offset)
+{
+	return offset < header->strings_size &&
+		memchr(ast_strings(header) + offset, '\0', header->strings_size - offset) != NULL;
+}
+
+bool ast_optional_string_is_valid(const AstHeader *header, uint32_t offset)
+{
+	return offset == AST_NONE || ast_string_is_valid(header, offset);
+}
+
+// checks every offset and index in the file, so that consumers can walk it without any bounds checks
+bool ast_is_valid(const AstHeader *header, size_t size)
+{
+	if (size < sizeof(AstHeader) || memcmp(header->magic, AST_MAGIC, sizeof(header->magic)) != 0 ||
+		header->version != AST_VERSION)
+	{
+		return false;
+	}
+
+	uint64_t expected_size = sizeof(AstHeader) + (uint64_t)header->stmt_count * sizeof(AstStmt) +
+		(uint64_t)header->expr_count * sizeof(AstExpr) + (uint64_t)header->name_count * sizeof(uint32_t) +
+		(uint64_t)header->arg_count * sizeof(uint32_t) + header->strings_size;
+	if (expected_size != size || header->module_stmt_count > header->stmt_count)
+	{
+		return false;
+	}
+
+	for (uint32_t i = 0; i < header->expr_count; i++)
+	{
+		const AstExpr *expr = &ast_exprs(header)[i];
+		switch (expr->kind)
+		{
+		case EXPR_IDENT:
+			if (!ast_string_is_valid(header, expr->name))
+			{
+				return false;
+			}
+			break;
+		case EXPR_ASSIGNMENT:
+			if (!ast_string_is_valid(header, expr->name) || expr->value >= i)
+			{
+				return false;
+			}
+			break;
+		case EXPR_CALL:
+			if (!ast_string_is_valid(header, expr->name) || expr->value > header->arg_count ||
+				expr->count > header->arg_count - expr->value)
+			{
+				return false;
+			}
+			for (uint32_t j = 0; j < expr->count; j++)
+			{
+				if (ast_args(header)[expr->value + j] >= i)
+				{
+					return false;
+				}
+			}
+			break;
+		case EXPR_NUM:
+		case EXPR_BOOL:
+		case EXPR_ERROR:
+			break;
+		default:
+			return false;
+		}
+	}
+
+	for (uint32_t i = 0; i < header->stmt_count; i++)
+	{
+		const AstStmt *stmt = &ast_stmts(header)[i];
+		bool ok;
+		bool names_ok = stmt->first_name <= header->name_count &&
+			stmt->name_count <= header->name_count - stmt->first_name;
+		for (uint32_t j = 0; names_ok && j < stmt->name_count; j++)
+		{
+			names_ok = ast_string_is_valid(header, ast_names(header)[stmt->first_name + j]);
+		}
+		switch (stmt->kind)
+		{
+		case STMT_EXPR:
+		case STMT_RETURN:
+			ok = stmt->expr < header->expr_count;
+			break;
+		case STMT_DECL:
+			ok = ast_string_is_valid(header, stmt->name) && ast_optional_string_is_valid(header, stmt->type_name);
+			if (stmt->decl_kind == DECL_LET)
+			{
+				ok = ok && stmt->expr < header->expr_count;
+			}
+			else if (stmt->decl_kind == DECL_FUNCTION)
+			{
+				ok = ok && stmt->type_name != AST_NONE && names_ok && stmt->name_count % 2 == 0 &&
+					stmt->first_stmt > i && stmt->first_stmt <= header->stmt_count &&
+					stmt->stmt_count <= header->stmt_count - stmt->first_stmt;
+			}
+			else
+			{
+				ok = ok && stmt->decl_kind == DECL_TYPE_ALIAS && stmt->type_name != AST_NONE;
+			}
+			break;
+		case STMT_IMPORT:
+			ok = ast_string_is_valid(header, stmt->specifier) && names_ok;
+			break;
+		case STMT_ERROR:
+			ok = true;
+			break;
+		default:
+			ok = false;
+		}
+		if (!ok)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+typedef struct
+{
+	const AstHeader *header;
+	size_t size;
+} AstFile;
+
+bool ast_map(int fd, AstFile *ast)
+{
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(AstHeader))
+	{
+		return false;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED)
+	{
+		return false;
+	}
+	if (!ast_is_valid(data, st.st_size))
+	{
+		munmap(data, st.st_size);
+		return false;
+	}
+
+	ast->header = data;
+	ast->size = st.st_size;
+	return true;
+}
+
+void ast_unmap(AstFile *ast)
+{
+	munmap((void *)ast->header, ast->size);
+}
+
+bool ast_expr_matches(const AstHeader *header, uint32_t index, Expr *expr)
+{
+	const char *strings = ast_strings(header);
+	while (true)
+	{
+		const AstExpr *node = &ast_exprs(header)[index];
+		if (node->kind != expr->kind || node->pos != expr->location.pos)
+		{
+			return false;
+		}
+
+		switch (expr->kind)
+		{
+		case EXPR_IDENT:
+			return strcmp(strings + node->name, symbol_text(expr->ident.sym)) == 0;
+		case EXPR_NUM:
+			return node->number == expr->num.value;
+		case EXPR_BOOL:
+			return node->value == expr->boolean;
+		case EXPR_ERROR:
+			return true;
+		case EXPR_CALL:
+			if (strcmp(strings + node->name, symbol_text(expr->call.callee.sym)) != 0 ||
+				node->count != (uint32_t)sbcount(expr->call.args))
+			{
+				return false;
+			}
+			for (uint32_t i = 0; i < node->count; i++)
+			{
+				if (!ast_expr_matches(header, ast_args(header)[node->value + i], &expr->call.args[i]))
+				{
+					return false;
+				}
+			}
+			return true;
+		case EXPR_ASSIGNMENT:
+			if (strcmp(strings + node->name, symbol_text(expr->assignment.name.sym)) != 0)
+			{
+				return false;
+			}
+			index = node->value;
+			expr = expr->assignment.expr;
+			break;
+		default:
+			return false;
+		}
+	}
+}
+
+bool ast_stmt_matches(const AstHeader *header, const AstStmt *node, Stmt *stmt);
+
+bool ast_function_matches(const AstHeader *header, const AstStmt *node, Function *function)
+{
+	const char *strings = ast_strings(header);
+	if (strcmp(strings + node->name, symbol_text(function->name.sym)) != 0 ||
+		strcmp(strings + node->type_name, symbol_text(function->return_type_name.sym)) != 0 ||
+		node->name_count != 2 * (uint32_t)sbcount(function->params) ||
+		node->stmt_count != (uint32_t)sbcount(function->body))
+	{
+		return false;
+	}
+	for (size_t i = 0; i < sbcount(function->params); i++)
+	{
+		const uint32_t *names = ast_names(header) + node->first_name + 2 * i;
+		if (strcmp(strings + names[0], symbol_text(function->params[i].name.sym)) != 0 ||
+			strcmp(strings + names[1], symbol_text(function->params[i].type_name.sym)) != 0)
+		{
+			return false;
+		}
+	}
+	for (uint32_t i = 0; i < node->stmt_count; i++)
+	{
+		if (!ast_stmt_matches(header, &ast_stmts(header)[node->first_stmt + i], &function->body[i]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ast_stmt_matches(const AstHeader *header, const AstStmt *node, Stmt *stmt)
+{
+	const char *strings = ast_strings(header);
+	if (node->kind != stmt->kind || node->pos != stmt->location.pos)
+	{
+		return false;
+	}
+
+	switch (stmt->kind)
+	{
+	case STMT_EXPR:
+	case STMT_RETURN:
+		return ast_expr_matches(header, node->expr, &stmt->expr);
+	case STMT_DECL:
+	{
+		Decl *decl = &stmt->decl;
+		if (node->decl_kind != decl->kind || node->decl_pos != decl->location.pos ||
+			node->exported != decl->exported)
+		{
+			return false;
+		}
+		if (decl->kind == DECL_TYPE_ALIAS)
+		{
+			return strcmp(strings + node->name, symbol_text(decl->type_alias.name.sym)) == 0 &&
+				strcmp(strings + node->type_name, symbol_text(decl->type_alias.type_name.sym)) == 0;
+		}
+		if (decl->kind == DECL_FUNCTION)
+		{
+			return ast_function_matches(header, node, &decl->function);
+		}
+		bool same_type_name = decl->let.type_name == NULL
+			? node->type_name == AST_NONE
+			: node->type_name != AST_NONE && strcmp(strings + node->type_name, symbol_text(decl->let.type_name->sym)) == 0;
+		return same_type_name && strcmp(strings + node->name, symbol_text(decl->let.name.sym)) == 0 &&
+			ast_expr_matches(header, node->expr, &decl->let.init);
+	}
+	case STMT_IMPORT:
+		if (strcmp(strings + node->specifier, stmt->import.specifier) != 0 ||
+			node->name_count != (uint32_t)sbcount(stmt->import.names))
+		{
+			return false;
+		}
+		for (uint32_t i = 0; i < node->name_count; i++)
+		{
+			if (strcmp(strings + ast_names(header)[node->first_name + i], symbol_text(stmt->import.names[i].sym)) != 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	case STMT_ERROR:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// compares a mapped AST with the in-memory one it was written from, node by node
+bool ast_matches_module(const AstHeader *header, Module *mod)
+{
+	if (header->module_stmt_count != (uint32_t)sbcount(mod->statements))
+	{
+		return false;
+	}
+	for (uint32_t i = 0; i < header->module_stmt_count; i++)
+	{
+		if (!ast_stmt_matches(header, &ast_stmts(header)[i], &mod->statements[i]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// reads a whole file into a NUL terminated string. the size comes from fstat rather than ftell, whose long result is
+// only 32 bits on some targets, and the read loops because read() may return fewer bytes than asked for
+int read_file_to_string(const char *filename, char **str, size_t *len)
+{
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+	{
+		return 1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return 1;
+	}
+
+	size_t length = st.st_size;
+	*str = malloc(length + 1);
+	if (!*str)
+	{
+		fprintf(stderr, "out of memory: could not allocate %zu bytes to read '%s'\n", length + 1, filename);
+		exit(1);
+	}
+
+	size_t done = 0;
+	while (done < length)
+	{
+		ssize_t n = read(fd, *str + done, length - done);
+		if (n <= 0)
+		{
+			free(*str);
+			close(fd);
+			return 1;
+		}
+		done += n;
+	}
+	close(fd);
+
+	(*str)[length] = '\0';
+	*len = length;
+	return 0;
+}
+
+// maps a file as a NUL terminated string. the file is mapped over a slightly larger anonymous mapping, so there is
+// always a zero byte after its contents, even when its size is a multiple of the page size
+int map_file_to_string(const char *filename, char **str, size_t *len)
+{
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+	{
+		return 1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return 1;
+	}
+
+	size_t length = st.st_size;
+	char *base = mmap(NULL, length + 1, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED)
+	{
+		close(fd);
+		return 1;
+	}
+	if (length > 0 && mmap(base, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+	{
+		munmap(base, length + 1);
+		close(fd);
+		return 1;
+	}
+	close(fd);
+
+	madvise(base, length, MADV_SEQUENTIAL);
+	*str = base;
+	*len = length;
+	return 0;
+}
+
+// unmaps a string returned by map_file_to_string, including the zero byte after it
+void unmap_string(char *str, size_t len)
+{
+	munmap(str, len + 1);
+}
+
+// drops the whole pages of a string returned by map_file_to_string that lie in [from, to). they are faulted back in
+// from the file if they are read again
+void release_mapped_range(const char *str, size_t from, size_t to)
+{
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	from = (from + page_size - 1) & ~(page_size - 1);
+	to &= ~(page_size - 1);
+	if (from < to)
+	{
+		madvise((char *)str + from, to - from, MADV_DONTNEED);
+	}
+}
+
+#define MAPPED_PASS_CHUNK (1 << 20)
+
+#define SUMMARY_MAGIC "SPTS"
+#define SUMMARY_VERSION 2
+
+// the resolved exports of a checked module, so that later runs can skip checking it. the file is laid out as the
+// header, then the imports, then the exports, then a blob of NUL terminated strings which the other sections refer to
+// by offset. there are no pointers, so a summary is used straight from an mmap
+typedef struct
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t source_hash;
+	// combined interface hashes of the imported modules, in import order
+	uint64_t deps_hash;
+	// hash of the exports below, which dependents build their deps_hash from
+	uint64_t interface_hash;
+	uint32_t real_path_offset;
+	uint32_t import_count;
+	uint32_t export_count;
+	uint32_t strings_size;
+} SummaryHeader;
+
+typedef struct
+{
+	uint32_t specifier_offset;
+} SummaryImport;
+
+typedef struct
+{
+	uint32_t name_offset;
+	// DECL_RESOLVED_LET or DECL_TYPE_ALIAS
+	uint32_t kind;
+	int32_t type_id;
+} SummaryExport;
+
+typedef struct
+{
+	const SummaryHeader *header;
+	size_t size;
+} Summary;
+
+const SummaryImport *summary_imports(const SummaryHeader *header)
+{
+	return (const SummaryImport *)(header + 1);
+}
+
+const SummaryExport *summary_exports(const SummaryHeader *header)
+{
+	return (const SummaryExport *)(summary_imports(header) + header->import_count);
+}
+
+const char *summary_strings(const SummaryHeader *header)
+{
+	return (const char *)(summary_exports(header) + header->export_count);
+}
+
+bool summary_string_is_valid(const SummaryHeader *header, uint32_t offset)
+{
+	return offset < header->strings_size && memchr(summary_strings(header) + offset, '\0',
+		header->strings_size - offset) != NULL;
+}
+
+bool summary_is_valid(const SummaryHeader *header, size_t size)
+{
+	if (size < sizeof(SummaryHeader) || memcmp(header->magic, SUMMARY_MAGIC, sizeof(header->magic)) != 0 ||
+		header->version != SUMMARY_VERSION)
+	{
+		return false;
+	}
+
+	uint64_t expected_size = sizeof(SummaryHeader) + (uint64_t)header->import_count * sizeof(SummaryImport) +
+		(uint64_t)header->export_count * sizeof(SummaryExport) + header->strings_size;
+	if (expected_size != size || !summary_string_is_valid(header, header->real_path_offset))
+	{
+		return false;
+	}
+
+	for (uint32_t i = 0; i < header->import_count; i++)
+	{
+		if (!summary_string_is_valid(header, summary_imports(header)[i].specifier_offset))
+		{
+			return false;
+		}
+	}
+	for (uint32_t i = 0; i < header->export_count; i++)
+	{
+		const SummaryExport *export = &summary_exports(header)[i];
+		bool kind_ok = export->kind == DECL_RESOLVED_LET || export->kind == DECL_TYPE_ALIAS;
+		bool type_ok = export->type_id == TYPE_NUMBER.id || export->type_id == TYPE_BOOL.id;
+		if (!kind_ok || !type_ok || !summary_string_is_valid(header, export->name_offset))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool summary_map(const char *path, Summary *summary)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SummaryHeader))
+	{
+		close(fd);
+		return false;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+	{
+		return false;
+	}
+
+	if (!summary_is_valid(data, st.st_size))
+	{
+		munmap(data, st.st_size);
+		return false;
+	}
+
+	summary->header = data;
+	summary->size = st.st_size;
+	return true;
+}
+
+void summary_unmap(Summary *summary)
+{
+	if (summary->header != NULL)
+	{
+		munmap((void *)summary->header, summary->size);
+		summary->header = NULL;
+		summary->size = 0;
+	}
+}
+
+uint32_t summary_add_string(char **strings, const char *s)
+{
+	size_t len = strlen(s) + 1;
+	uint32_t offset = sbcount(*strings);
+	memcpy(sbadd(*strings, len), s, len);
+	return offset;
+}
+
+// hashes everything about the exports that an importer can observe
+uint64_t exports_interface_hash(Hashmap *exports)
+{
+	uint64_t hash = 0;
+	for (size_t i = 0; i < exports->cap; i++)
+	{
+		HashmapEntry *entry = &exports->entries[i];
+		if (!entry->in_use)
+		{
+			continue;
+		}
+
+		Type ty = { 0 };
+		if (entry->val.kind == DECL_RESOLVED_LET)
+		{
+			ty = entry->val.resolved_let.ty;
+		}
+		else
+		{
+			type_from_name(symbol_text(entry->val.type_alias.type_name.sym), &ty);
+		}
+		// symbols are numbered in the order that threads happen to intern them, so the hash has to be of the text. that
+		// order also decides which slot each export lands in, so the hashes of the exports are summed rather than chained
+		uint64_t entry_hash = hash_string(symbol_text(entry->key));
+		entry_hash = hash_combine(entry_hash, entry->val.kind);
+		entry_hash = hash_combine(entry_hash, ty.id);
+		hash += entry_hash;
+	}
+	return hash;
+}
+
+#define FILE_NOT_FOUND SIZE_MAX
+
+typedef struct
+{
+	// the path as it is displayed in diagnostics
+	char *path;
+	// the canonical path, used to tell whether two import specifiers refer to the same file
+	char *real_path;
+	uint64_t real_path_hash;
+	char *source;
+	size_t source_len;
+	bool source_mapped;
+	uint64_t source_hash;
+	// a summary from an earlier run whose source hash matches, or NULL. it can only be used instead of checking the
+	// file if the interfaces of the files it imports haven't changed either
+	Summary summary;
+
+	// one entry per import statement: its specifier, and the index of the file it resolves to (or FILE_NOT_FOUND).
+	// the specifiers are found once per source, the deps are resolved again whenever the set of files changes
+	char **specifiers;
+	bool scanned;
+	size_t *deps;
+	size_t *dependents;
+	// number of deps that have not been checked yet. the file is ready to be checked once it reaches 0
+	size_t pending_deps;
+
+	bool checked;
+	ParseResult result;
+	Module module;
+	Hashmap exports;
+	uint64_t interface_hash;
+	char *diagnostics;
+	size_t diagnostics_len;
+	// the types of the query roots, if the file was queried rather than checked
+	char *answers;
+	size_t answers_len;
+	// stretchy buffer sorted by position, every identifier of the first file if positions are hovered
+	Span *spans;
+
+	// set once the file has been checked, until its source changes. with --watch, a file that is up to date keeps its
+	// result as long as the interfaces of the files it imports hash to checked_deps_hash
+	bool up_to_date;
+	uint64_t checked_deps_hash;
+	// set if the file was checked in the latest round rather than keeping its result
+	bool rechecked;
+	// set if the file was deleted while watching. a removed file is never found, resolved or checked again
+	bool removed;
+} SourceFile;
+
+// a set of modules connected by imports. files are checked on a pool of threads, each one as soon as all of the
+// files it imports have been checked
+typedef struct
+{
+	// stretchy buffer
+	SourceFile *files;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	// stretchy buffer used as a queue of files that are ready to be checked, the queue starts at ready_head
+	size_t *ready;
+	size_t ready_head;
+	// number of files being checked right now
+	size_t running;
+
+	// where export summaries are read from and written to, NULL if they are not used
+	const char *summary_dir;
+	size_t max_expr_depth;
+	// check files in streaming mode, see Parser.stream
+	bool stream;
+	// names whose types are queried from the first file, NULL to check it fully. only the declarations they need are
+	// checked, see parser_parse_query
+	char **query_roots;
+	// stretchy buffer of byte offsets into the first file to describe the identifiers at, NULL if none are hovered
+	size_t *hover_positions;
+} Program;
+
+void program_init(Program *program)
+{
+	program->files = NULL;
+	program->summary_dir = NULL;
+	program->max_expr_depth = DEFAULT_MAX_EXPR_DEPTH;
+	program->stream = false;
+	program->query_roots = NULL;
+	program->hover_positions = NULL;
+	pthread_mutex_init(&program->lock, NULL);
+	pthread_cond_init(&program->cond, NULL);
+	program->ready = NULL;
+	program->ready_head = 0;
+	program->running = 0;
+}
+
+size_t program_find_file(Program *program, const char *real_path)
+{
+	uint64_t hash = hash_string(real_path);
+	for (size_t i = 0; i < sbcount(program->files); i++)
+	{
+		SourceFile *file = &program->files[i];
+		if (!file->removed && file->real_path_hash == hash && strcmp(file->real_path, real_path) == 0)
+		{
+			return i;
+		}
+	}
+	return FILE_NOT_FOUND;
+}
+
+char *program_summary_path(Program *program, const char *real_path)
+{
+	size_t len = strlen(program->summary_dir) + sizeof("/0123456789abcdef.tsum");
+	char *path = malloc(len);
+	snprintf(path, len, "%s/%016llx.tsum", program->summary_dir, (unsigned long long)hash_string(real_path));
+	return path;
+}
+
+// hashes a source in chunks, so that a mapped source can be released as it goes
+uint64_t source_hash(const char *source, size_t len, bool mapped)
+{
+	uint64_t hash = 0;
+	for (size_t pos = 0; pos < len; pos += MAPPED_PASS_CHUNK)
+	{
+		size_t chunk_len = len - pos < MAPPED_PASS_CHUNK ? len - pos : MAPPED_PASS_CHUNK;
+		hash = hash_combine(hash, hash_bytes(source + pos, chunk_len));
+		if (mapped)
+		{
+			release_mapped_range(source, pos, pos + chunk_len);
+		}
+	}
+	return hash;
+}
+
+// sets the source of `file`, and maps the summary that was written from it if there is one
+void program_set_source(Program *program, SourceFile *file, char *source, size_t source_len, bool source_mapped)
+{
+	file->source = source;
+	file->source_len = source_len;
+	file->source_mapped = source_mapped;
+	// only summaries need the hash, and it is a pass over the whole file
+	file->source_hash = program->summary_dir != NULL ? source_hash(source, source_len, source_mapped) : 0;
+	file->summary = (Summary){ .header = NULL, .size = 0 };
+
+	if (program->summary_dir != NULL)
+	{
+		char *summary_path = program_summary_path(program, file->real_path);
+		if (summary_map(summary_path, &file->summary))
+		{
+			const SummaryHeader *header = file->summary.header;
+			bool same_file = strcmp(summary_strings(header) + header->real_path_offset, file->real_path) == 0;
+			if (!same_file || header->source_hash != file->source_hash)
+			{
+				summary_unmap(&file->summary);
+			}
+		}
+		free(summary_path);
+	}
+}
+
+size_t program_add_source(Program *program, char *path, char *real_path, char *source, size_t source_len,
+	bool source_mapped)
+{
+	SourceFile file = {
+		.path = path,
+		.real_path = real_path,
+		.real_path_hash = hash_string(real_path),
+		.specifiers = NULL,
+		.scanned = false,
+		.deps = NULL,
+		.dependents = NULL,
+		.pending_deps = 0,
+		.checked = false,
+		.result = PARSE_RESULT_OK,
+		.module = { .statements = NULL },
+		.diagnostics = NULL,
+		.diagnostics_len = 0,
+		.answers = NULL,
+		.answers_len = 0,
+		.spans = NULL,
+		.interface_hash = 0,
+		.up_to_date = false,
+		.checked_deps_hash = 0,
+		.rechecked = false,
+		.removed = false,
+	};
+	hm_init(&file.exports);
+	program_set_source(program, &file, source, source_len, source_mapped);
+
+	sbpush(program->files, file);
+	return sbcount(program->files) - 1;
+}
+
+// adds the file at `path` to the program unless it is already part of it. returns the index of the file, or
+// FILE_NOT_FOUND if it cannot be read
+size_t program_add_file(Program *program, const char *path)
+{
+	char *real_path = realpath(path, NULL);
+	if (real_path == NULL)
+	{
+		return FILE_NOT_FOUND;
+	}
+
+	size_t existing = program_find_file(program, real_path);
+	if (existing != FILE_NOT_FOUND)
+	{
+		free(real_path);
+		return existing;
+	}
+
+	// when streaming, the source is mapped rather than read so that it doesn't have to stay in memory either
+	// a mapped source is really read by the page faults of the phases that go through it
+	perf_enter(PERF_PHASE_READ);
+	uint64_t trace_start = trace_begin();
+	char *source;
+	size_t source_len;
+	int err = program->stream ? map_file_to_string(path, &source, &source_len)
+		: read_file_to_string(path, &source, &source_len);
+	perf_exit();
+	// the event can only name the file by a path the program keeps, and it keeps none for a file it could not read
+	if (err != 0)
+	{
+		trace_end_file("read", NULL, trace_start, -1, "failed");
+		free(real_path);
+		return FILE_NOT_FOUND;
+	}
+
+	size_t index = program_add_source(program, strdup(path), real_path, source, source_len, program->stream);
+	trace_end_file("read", program->files[index].path, trace_start, source_len, NULL);
+	return index;
+}
+
+bool is_regular_file(const char *path)
+{
+	struct stat st;
+	return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+// resolves `specifier` relative to the directory of `importer`, trying the path as-is and then with a .ts extension.
+// returns NULL if there is no such file
+char *resolve_specifier(const char *importer, const char *specifier)
+{
+	while (strncmp(specifier, "./", 2) == 0)
+	{
+		specifier += 2;
+	}
+
+	const char *slash = strrchr(importer, '/');
+	size_t dir_len = slash == NULL ? 0 : (size_t)(slash - importer) + 1;
+	size_t specifier_len = strlen(specifier);
+
+	char *path = malloc(dir_len + specifier_len + sizeof(".ts"));
+	memcpy(path, importer, dir_len);
+	memcpy(path + dir_len, specifier, specifier_len + 1);
+	if (is_regular_file(path))
+	{
+		return path;
+	}
+
+	memcpy(path + dir_len + specifier_len, ".ts", sizeof(".ts"));
+	if (is_regular_file(path))
+	{
+		return path;
+	}
+
+	free(path);
+	return NULL;
+}
+
+// how many more braces `s` opens than it closes
+long brace_balance(const char *s, size_t len)
+{
+	long balance = 0;
+	for (size_t i = 0; i < len; i++)
+	{
+		balance += (s[i] == '{') - (s[i] == '}');
+	}
+	return balance;
+}
+
+// finds the specifiers of every top level import statement in `source` without parsing the rest of it. strings only
+// ever appear in import statements and there are no comments, so searching for the keyword cannot be fooled, and
+// braces only ever open function bodies and the names of imports, so counting them tells whether an import is in a
+// function body. the search goes through the source a chunk at a time, so that a mapped source can be released behind it
+char **scan_import_specifiers(const char *source, size_t len, bool mapped)
+{
+	char **specifiers = NULL;
+	const size_t keyword_len = sizeof("import") - 1;
+	Lexer *lexer = lexer_create(source, len);
+
+	size_t pos = 0;
+	// how deep in function bodies `pos` is
+	long depth = 0;
+	while (pos < len)
+	{
+		size_t chunk_end = len - pos < MAPPED_PASS_CHUNK ? len : pos + MAPPED_PASS_CHUNK;
+		const char *match = memmem(source + pos, chunk_end - pos, "import", keyword_len);
+		if (match == NULL)
+		{
+			if (chunk_end == len)
+			{
+				break;
+			}
+			// the keyword may straddle the end of the chunk
+			size_t next = chunk_end - (keyword_len - 1);
+			depth += brace_balance(source + pos, next - pos);
+			if (mapped)
+			{
+				release_mapped_range(source, pos, next);
+			}
+			pos = next;
+			continue;
+		}
+
+		size_t start = match - source;
+		depth += brace_balance(source + pos, start - pos);
+		pos = start + keyword_len;
+		if ((start > 0 && is_identifier_char(source[start - 1])) || (pos < len && is_identifier_char(source[pos])) ||
+			depth > 0)
+		{
+			continue;
+		}
+
+		lexer_seek(lexer, start);
+		lexer_scan(lexer);
+		lexer_scan(lexer);
+		if (lexer->token->kind != TOK_LBRACE)
+		{
+			continue;
+		}
+		do
+		{
+			lexer_scan(lexer);
+		} while (lexer->token->kind == TOK_IDENT || lexer->token->kind == TOK_COMMA);
+		if (lexer->token->kind != TOK_RBRACE)
+		{
+			continue;
+		}
+		lexer_scan(lexer);
+		if (lexer->token->kind != TOK_IDENT || strcmp(lexer->token->text, "from") != 0)
+		{
+			continue;
+		}
+		lexer_scan(lexer);
+		if (lexer->token->kind == TOK_STRING)
+		{
+			sbpush(specifiers, lexer->token->text);
+		}
+		pos = lexer->pos;
+	}
+
+	if (mapped)
+	{
+		release_mapped_range(source, 0, len);
+	}
+	lexer_seek(lexer, 0);
+	free(lexer);
+	return specifiers;
+}
+
+// adds every file reachable through imports from the files already in the program, and links them up
+void program_discover_imports(Program *program)
+{
+	// files are appended while iterating, so that they get scanned as well
+	for (size_t i = 0; i < sbcount(program->files); i++)
+	{
+		SourceFile *file = &program->files[i];
+		if (file->removed)
+		{
+			continue;
+		}
+		if (!file->scanned)
+		{
+			const SummaryHeader *header = file->summary.header;
+			if (header != NULL)
+			{
+				// the summary was written from this exact source, so it knows the imports without lexing anything
+				for (uint32_t j = 0; j < header->import_count; j++)
+				{
+					sbpush(file->specifiers,
+						(char *)summary_strings(header) + summary_imports(header)[j].specifier_offset);
+				}
+			}
+			else
+			{
+				uint64_t trace_start = trace_begin();
+				file->specifiers = scan_import_specifiers(file->source, file->source_len, file->source_mapped);
+				trace_end_file("scan imports", file->path, trace_start, file->source_len, NULL);
+			}
+			file->scanned = true;
+		}
+
+		for (size_t j = 0; j < sbcount(program->files[i].specifiers); j++)
+		{
+			size_t dep = FILE_NOT_FOUND;
+			char *path = resolve_specifier(program->files[i].path, program->files[i].specifiers[j]);
+			if (path != NULL)
+			{
+				dep = program_add_file(program, path);
+				free(path);
+			}
+
+			file = &program->files[i];
+			sbpush(file->deps, dep);
+			if (dep != FILE_NOT_FOUND)
+			{
+				file->pending_deps++;
+				sbpush(program->files[dep].dependents, (size_t)i);
+			}
+		}
+	}
+}
+
+bool program_deps_hash(Program *program, SourceFile *file, uint64_t *hash)
+{
+	*hash = 0;
+	for (size_t i = 0; i < sbcount(file->deps); i++)
+	{
+		if (file->deps[i] == FILE_NOT_FOUND)
+		{
+			return false;
+		}
+		*hash = hash_combine(*hash, program->files[file->deps[i]].interface_hash);
+	}
+	return true;
+}
+
+// loads the exports of `file` from its summary, if the summary is still up to date
+bool program_load_summary(Program *program, SourceFile *file)
+{
+	const SummaryHeader *header = file->summary.header;
+	uint64_t deps_hash;
+	if (header == NULL || !program_deps_hash(program, file, &deps_hash) || deps_hash != header->deps_hash)
+	{
+		return false;
+	}
+
+	const char *strings = summary_strings(header);
+	for (uint32_t i = 0; i < header->export_count; i++)
+	{
+		const SummaryExport *export = &summary_exports(header)[i];
+		Ident name = { .sym = intern_string(strings + export->name_offset) };
+		Type ty = { .id = export->type_id };
+		Decl decl = export->kind == DECL_RESOLVED_LET
+			? decl_resolved_let_create((Location){ 0 }, name, ty)
+			: decl_type_alias_create((Location){ 0 }, name, (Ident){ .sym = intern_string(type_name(ty)) });
+		hm_add(&file->exports, name.sym, decl);
+	}
+
+	file->interface_hash = header->interface_hash;
+	file->result = PARSE_RESULT_OK;
+	return true;
+}
+
+void program_write_summary(Program *program, SourceFile *file)
+{
+	uint64_t deps_hash;
+	if (!program_deps_hash(program, file, &deps_hash))
+	{
+		return;
+	}
+
+	char *strings = NULL;
+	SummaryImport *imports = NULL;
+	SummaryExport *exports = NULL;
+	uint32_t real_path_offset = summary_add_string(&strings, file->real_path);
+	for (size_t i = 0; i < sbcount(file->specifiers); i++)
+	{
+		SummaryImport import = { .specifier_offset = summary_add_string(&strings, file->specifiers[i]) };
+		sbpush(imports, import);
+	}
+	for (size_t i = 0; i < file->exports.cap; i++)
+	{
+		HashmapEntry *entry = &file->exports.entries[i];
+		if (!entry->in_use)
+		{
+			continue;
+		}
+		SummaryExport export = {
+			.name_offset = summary_add_string(&strings, symbol_text(entry->key)),
+			.kind = entry->val.kind,
+			.type_id = 0,
+		};
+		Type ty = { 0 };
+		if (entry->val.kind == DECL_RESOLVED_LET)
+		{
+			ty = entry->val.resolved_let.ty;
+		}
+		else
+		{
+			type_from_name(symbol_text(entry->val.type_alias.type_name.sym), &ty);
+		}
+		export.type_id = ty.id;
+		sbpush(exports, export);
+	}
+
+	// a summary is only a cache, so a file too large for its 32 bit offsets is simply checked from source every time
+	if (sbcount(strings) > UINT32_MAX || sbcount(exports) > UINT32_MAX)
+	{
+		sbfree(strings);
+		sbfree(imports);
+		sbfree(exports);
+		return;
+	}
+
+	SummaryHeader header = {
+		.version = SUMMARY_VERSION,
+		.source_hash = file->source_hash,
+		.deps_hash = deps_hash,
+		.interface_hash = file->interface_hash,
+		.real_path_offset = real_path_offset,
+		.import_count = sbcount(imports),
+		.export_count = sbcount(exports),
+		.strings_size = sbcount(strings),
+	};
+	memcpy(header.magic, SUMMARY_MAGIC, sizeof(header.magic));
+
+	// write to a temporary file first, so that a concurrent run never maps a half written summary
+	char *path = program_summary_path(program, file->real_path);
+	size_t tmp_len = strlen(path) + 32;
+	char *tmp_path = malloc(tmp_len);
+	snprintf(tmp_path, tmp_len, "%s.%ld.tmp", path, (long)getpid());
+
+	FILE *f = fopen(tmp_path, "wb");
+	if (f != NULL)
+	{
+		bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+		// an empty stretchy buffer is NULL, which must not be passed to fwrite even with a count of 0
+		ok = ok && (header.import_count == 0 ||
+			fwrite(imports, sizeof(SummaryImport), header.import_count, f) == header.import_count);
+		ok = ok && (header.export_count == 0 ||
+			fwrite(exports, sizeof(SummaryExport), header.export_count, f) == header.export_count);
+		ok = ok && fwrite(strings, 1, header.strings_size, f) == header.strings_size;
+		ok = fclose(f) == 0 && ok;
+		if (!ok || rename(tmp_path, path) != 0)
+		{
+			remove(tmp_path);
+		}
+	}
+
+	free(tmp_path);
+	free(path);
+	sbfree(strings);
+	sbfree(imports);
+	sbfree(exports);
+}
+
+// frees the result of checking a file before it is checked again
+void source_file_clear_result(SourceFile *file)
+{
+	for (size_t i = 0; i < sbcount(file->module.statements); i++)
+	{
+		stmt_free(&file->module.statements[i]);
+	}
+	sbfree(file->module.statements);
+	file->module.statements = NULL;
+	free(file->exports.entries);
+	hm_init(&file->exports);
+	free(file->diagnostics);
+	file->diagnostics = NULL;
+	file->diagnostics_len = 0;
+	sbfree(file->spans);
+	file->spans = NULL;
+	file->result = PARSE_RESULT_OK;
+}
+
+// frees or unmaps the source of a file, whichever way it was loaded
+void source_file_free_source(SourceFile *file)
+{
+	if (file->source_mapped)
+	{
+		unmap_string(file->source, file->source_len);
+	}
+	else
+	{
+		free(file->source);
+	}
+	file->source = NULL;
+}
+
+void program_check_file(Program *program, size_t index)
+{
+	SourceFile *file = &program->files[index];
+	uint64_t trace_start = trace_begin();
+	uint64_t deps_hash;
+	if (file->up_to_date && program_deps_hash(program, file, &deps_hash) && deps_hash == file->checked_deps_hash)
+	{
+		trace_end_file("check", file->path, trace_start, file->source_len, "reused");
+		return;
+	}
+
+	source_file_clear_result(file);
+	file->rechecked = true;
+	if (program_load_summary(program, file))
+	{
+		file->up_to_date = program_deps_hash(program, file, &file->checked_deps_hash);
+		trace_end_file("check", file->path, trace_start, file->source_len, "summary");
+		return;
+	}
+
+	FILE *diagnostics = open_memstream(&file->diagnostics, &file->diagnostics_len);
+
+	Parser *parser = parser_create(lexer_create(file->source, file->source_len));
+	parser->lexer->source_mapped = file->source_mapped;
+	parser->diagnostics = diagnostics;
+	parser->max_expr_depth = program->max_expr_depth;
+	parser->stream = program->stream;
+	parser->index_spans = index == 0 && program->hover_positions != NULL;
+	for (size_t i = 0; i < sbcount(file->specifiers); i++)
+	{
+		Hashmap *exports = file->deps[i] == FILE_NOT_FOUND ? NULL : &program->files[file->deps[i]].exports;
+		ResolvedImport import = { .specifier = file->specifiers[i], .exports = exports };
+		sbpush(parser->imports, import);
 	}
 
-	int prev_cap = hm->cap;
-	hm->cap = prev_cap * 2;
-	hm->entries = realloc(hm->entries, sizeof(HashmapEntry) * hm->cap);
-	for (int i = prev_cap; i < hm->cap; i++)
+	// lexing, parsing and checking are interleaved token by token, so they are one span. timing each token would cost
+	// more than the work itself
+	// a queried file only exports what its roots needed, so its summary would be incomplete
+	bool query = index == 0 && program->query_roots != NULL;
+	uint64_t parse_start = trace_begin();
+	if (query)
 	{
-		hm->entries[i] = (const HashmapEntry){ 0 };
+		FILE *answers = open_memstream(&file->answers, &file->answers_len);
+		file->result = parser_parse_query(parser, program->query_roots, answers);
+		fclose(answers);
 	}
+	else
+	{
+		file->result = parser_parse(parser, &file->module);
+	}
+	trace_end("parse and check", parse_start);
+	free(file->exports.entries);
+	file->exports = parser->exports;
+	file->interface_hash = exports_interface_hash(&file->exports);
+	span_index_sort(parser->spans);
+	file->spans = parser->spans;
+	parser_free(parser);
+
+	fclose(diagnostics);
+	file->up_to_date = program_deps_hash(program, file, &file->checked_deps_hash);
+
+	if (program->summary_dir != NULL && !query && file->result == PARSE_RESULT_OK)
+	{
+		uint64_t write_start = trace_begin();
+		program_write_summary(program, file);
+		trace_end("write summary", write_start);
+	}
+
+	trace_end_file("check", file->path, trace_start, file->source_len, parse_result_name(file->result));
 }
 
-void hm_add(Hashmap *hm, const char *key, Decl val)
+void *program_worker(void *arg)
 {
-	hm_ensure(hm, ++hm->size);
+	Program *program = arg;
 
-	for (int i = 0; i < hm->cap; i++)
+	pthread_mutex_lock(&program->lock);
+	while (true)
 	{
-		if (!hm->entries[i].in_use)
+		uint64_t idle_start = trace_begin();
+		while (program->ready_head == (size_t)sbcount(program->ready) && program->running > 0)
 		{
-			HashmapEntry entry = { .in_use = true, .key = key, .val = val };
-			hm->entries[i] = entry;
-			return;
+			pthread_cond_wait(&program->cond, &program->lock);
 		}
+		trace_end("idle", idle_start);
+		if (program->ready_head == (size_t)sbcount(program->ready))
+		{
+			// nothing is running, so nothing else can become ready
+			break;
+		}
+
+		size_t index = program->ready[program->ready_head++];
+		program->running++;
+		pthread_mutex_unlock(&program->lock);
 
-		if (strcmp(hm->entries[i].key, key) == 0)
+		program_check_file(program, index);
+
+		pthread_mutex_lock(&program->lock);
+		program->running--;
+		SourceFile *file = &program->files[index];
+		file->checked = true;
+		for (size_t i = 0; i < sbcount(file->dependents); i++)
 		{
-			hm->entries[i].val = val;
-			return;
+			size_t dependent = file->dependents[i];
+			if (--program->files[dependent].pending_deps == 0)
+			{
+				sbpush(program->ready, dependent);
+			}
 		}
+		pthread_cond_broadcast(&program->cond);
 	}
+	pthread_cond_broadcast(&program->cond);
+	pthread_mutex_unlock(&program->lock);
 
-	UNREACHABLE("could not insert key '%s' into hashmap\n", key);
+	perf_flush();
+	return NULL;
 }
 
-bool hm_get(Hashmap *hm, const char *key, Decl *result)
+void program_append_diagnostic(SourceFile *file, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+void program_append_diagnostic(SourceFile *file, const char *fmt, ...)
+{
+	// open_memstream would start a new buffer, so the message is formatted on its own and copied after the others
+	char *text = NULL;
+	size_t len = 0;
+	FILE *diagnostics = open_memstream(&text, &len);
+	va_list args;
+	va_start(args, fmt);
+	vfprintf(diagnostics, fmt, args);
+	va_end(args);
+	fclose(diagnostics);
+
+	file->diagnostics = realloc(file->diagnostics, file->diagnostics_len + len + 1);
+	memcpy(file->diagnostics + file->diagnostics_len, text, len + 1);
+	file->diagnostics_len += len;
+	free(text);
+}
+
+// every file that could not be checked either is part of an import cycle, or depends on a file that is
+void program_report_cycles(Program *program)
 {
-	for (int i = 0; i < hm->cap; i++)
+	size_t count = sbcount(program->files);
+	// 0 = not visited, 1 = on the current path, 2 = reported
+	char *marks = calloc(count, sizeof(char));
+	size_t *path = NULL;
+
+	for (size_t start = 0; start < count; start++)
 	{
-		HashmapEntry entry = hm->entries[i];
-		if (!entry.in_use)
+		if (program->files[start].checked || marks[start] != 0)
 		{
 			continue;
 		}
 
-		if (strcmp(entry.key, key) == 0)
+		// an unchecked file always has an unchecked dep, so following them must end up in a cycle or at a file that
+		// has already been reported
+		size_t cur = start;
+		while (marks[cur] == 0)
 		{
-			*result = entry.val;
-			return true;
+			marks[cur] = 1;
+			sbpush(path, cur);
+			SourceFile *file = &program->files[cur];
+			for (size_t i = 0; i < sbcount(file->deps); i++)
+			{
+				if (file->deps[i] != FILE_NOT_FOUND && !program->files[file->deps[i]].checked)
+				{
+					cur = file->deps[i];
+					break;
+				}
+			}
+		}
+
+		size_t cycle_start = sbcount(path);
+		if (marks[cur] == 1)
+		{
+			while (path[cycle_start - 1] != cur)
+			{
+				cycle_start--;
+			}
+			cycle_start--;
+
+			char *cycle = NULL;
+			size_t cycle_len = 0;
+			FILE *out = open_memstream(&cycle, &cycle_len);
+			for (size_t i = cycle_start; i < sbcount(path); i++)
+			{
+				fprintf(out, "%s -> ", program->files[path[i]].path);
+			}
+			fprintf(out, "%s", program->files[cur].path);
+			fclose(out);
+
+			for (size_t i = cycle_start; i < sbcount(path); i++)
+			{
+				program_append_diagnostic(&program->files[path[i]], "import cycle: %s\n", cycle);
+			}
+			free(cycle);
+		}
+
+		for (size_t i = 0; i < cycle_start; i++)
+		{
+			program_append_diagnostic(&program->files[path[i]],
+				"cannot check %s: it depends on a module in an import cycle\n", program->files[path[i]].path);
+		}
+
+		for (size_t i = 0; i < sbcount(path); i++)
+		{
+			marks[path[i]] = 2;
+			program->files[path[i]].result = PARSE_RESULT_IMPORT_CYCLE;
 		}
+		stb__sbn(path) = 0;
 	}
 
-	return false;
+	sbfree(path);
+	free(marks);
 }
 
-bool hm_has(Hashmap *hm, const char *key)
+// the entry point of the threads that program_check starts
+void *program_worker_thread(void *arg)
 {
-	Decl dummy;
-	return hm_get(hm, key, &dummy);
+	program_worker(arg);
+	perf_thread_close();
+	return NULL;
 }
 
-struct Scope_
-{
-	Scope *parent;
-	Hashmap bindings;
-};
-
-void scope_init(Scope *scope, Scope *parent)
+void program_check(Program *program, size_t jobs)
 {
-	scope->parent = parent;
-	hm_init(&scope->bindings);
-}
+	for (size_t i = 0; i < sbcount(program->files); i++)
+	{
+		if (!program->files[i].removed && program->files[i].pending_deps == 0)
+		{
+			sbpush(program->ready, (size_t)i);
+		}
+	}
 
-bool scope_get_value(Scope *s, const char *name, Decl *decl)
-{
-	if (hm_get(&s->bindings, name, decl))
+	if (jobs > (size_t)sbcount(program->files))
 	{
-		return true;
+		jobs = sbcount(program->files);
 	}
 
-	if (s->parent != NULL)
+	pthread_t *threads = calloc(jobs, sizeof(pthread_t));
+	for (size_t i = 1; i < jobs; i++)
+	{
+		pthread_create(&threads[i], NULL, program_worker_thread, program);
+	}
+	program_worker(program);
+	for (size_t i = 1; i < jobs; i++)
 	{
-		return scope_get_value(s->parent, name, decl);
+		pthread_join(threads[i], NULL);
 	}
+	free(threads);
 
-	return false;
+	program_report_cycles(program);
+
+	// nothing reads a mapped source after checking, and keeping the mappings would hold on to address space for the
+	// rest of the run
+	for (size_t i = 0; i < sbcount(program->files); i++)
+	{
+		SourceFile *file = &program->files[i];
+		if (file->source_mapped && file->source != NULL)
+		{
+			source_file_free_source(file);
+		}
+	}
 }
 
-void scope_declare(Scope *s, const char *name, Decl decl)
+// prints the diagnostics of every file. returns the exit status: 1 if any file failed to check
+int program_report(Program *program)
 {
-	hm_add(&s->bindings, name, decl);
+	int status = 0;
+	size_t count = 0;
+	for (size_t i = 0; i < sbcount(program->files); i++)
+	{
+		count += !program->files[i].removed;
+	}
+	for (size_t i = 0; i < sbcount(program->files); i++)
+	{
+		SourceFile *file = &program->files[i];
+		if (file->removed)
+		{
+			continue;
+		}
+		// a file whose summary was used has no diagnostics buffer at all
+		if (file->diagnostics_len > 0)
+		{
+			fwrite(file->diagnostics, 1, file->diagnostics_len, stderr);
+		}
+		if (file->result == PARSE_RESULT_OK)
+		{
+			continue;
+		}
+
+		status = 1;
+		if (count == 1)
+		{
+			fprintf(stderr, "failed to parse: %s\n", parse_result_name(file->result));
+		}
+		else
+		{
+			fprintf(stderr, "%s: failed to parse: %s\n", file->path, parse_result_name(file->result));
+		}
+	}
+	return status;
 }
 
-bool scope_is_declared(Scope *s, const char *name)
+// prints what the identifier at each position refers to, one line per position
+void hover_report(SourceFile *file, size_t *positions, FILE *out)
 {
-	Decl dummy;
-	return scope_get_value(s, name, &dummy);
+	size_t count = sbcount(positions);
+	Span **found = malloc(count * sizeof(Span *));
+	span_index_find_all(file->spans, positions, count, found);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		Span *span = found[i];
+		if (span == NULL)
+		{
+			fprintf(out, "%zu: nothing\n", positions[i]);
+			continue;
+		}
+
+		const char *name = symbol_text(span->name);
+		const char *ty = span->typed ? type_name(span->ty) : "unknown";
+		fprintf(out, "%zu: ", positions[i]);
+		switch (span->decl_kind)
+		{
+		case DECL_LET:
+		case DECL_RESOLVED_LET:
+			fprintf(out, "let %s: %s", name, ty);
+			break;
+		case DECL_TYPE_ALIAS:
+			fprintf(out, "type %s = %s", name, ty);
+			break;
+		case DECL_FUNCTION:
+			fprintf(out, "function %s(...): %s", name, ty);
+			break;
+		case DECL_ERROR:
+			fprintf(out, "%s: %s", name, ty);
+			break;
+		}
+		if (span->decl_pos == SIZE_MAX)
+		{
+			fprintf(out, ", builtin\n");
+		}
+		else
+		{
+			fprintf(out, ", declared at %zu\n", span->decl_pos);
+		}
+	}
+
+	free(found);
 }
 
-bool expr_infer_type(Expr expr, Scope *scope, Type *ty)
+// writes the AST of `file` to `path` (or a temporary file if it is NULL). if `verify` is set, the written file is
+// mapped back in and compared with the in-memory AST
+bool emit_ast(SourceFile *file, const char *path, bool verify)
 {
-	switch (expr.kind)
+	char tmp_path[] = "/tmp/single_pass_tsc_ast.XXXXXX";
+	int fd = path != NULL ? open(path, O_RDWR | O_CREAT | O_TRUNC, 0666) : mkstemp(tmp_path);
+	if (fd < 0)
 	{
-	case EXPR_IDENT:
+		fprintf(stderr, "cannot open '%s': %s\n", path != NULL ? path : tmp_path, strerror(errno));
+		return false;
+	}
+	if (path == NULL)
 	{
-		Decl decl;
-		bool ok = scope_get_value(scope, expr.ident.text, &decl);
-		ok = ok && decl.kind == DECL_LET;
-		if (ok)
+		unlink(tmp_path);
+	}
+
+	FILE *f = fdopen(fd, "wb+");
+	if (!ast_write(&file->module, f))
+	{
+		fprintf(stderr, "cannot write AST of '%s'\n", file->path);
+		fclose(f);
+		return false;
+	}
+
+	bool ok = true;
+	if (verify)
+	{
+		AstFile ast;
+		ok = ast_map(fd, &ast);
+		if (!ok)
 		{
-			return expr_infer_type(decl.let.init, scope, ty);
+			fprintf(stderr, "AST of '%s' is not valid after writing it\n", file->path);
+		}
+		else
+		{
+			ok = ast_matches_module(ast.header, &file->module);
+			printf("AST round trip of %s: %u statements, %u expressions, %s\n", file->path, ast.header->stmt_count,
+				ast.header->expr_count, ok ? "ok" : "MISMATCH");
+			ast_unmap(&ast);
 		}
-		return ok;
-	}
-	case EXPR_ASSIGNMENT:
-		return expr_infer_type(*expr.assignment.expr, scope, ty);
-	case EXPR_NUM:
-		*ty = TYPE_NUMBER;
-		return true;
-	case EXPR_BOOL:
-		*ty = TYPE_BOOL;
-		return true;
-	default:
-		UNREACHABLE("unexpected expr of kind '%d'\n", expr.kind);
 	}
+
+	fclose(f);
+	return ok;
 }
 
+#ifdef __linux__
+// how long the events of a burst may be apart, and how long a burst may be delayed in total before it is checked
+#define WATCH_QUIET_MS 2
+#define WATCH_MAX_DELAY_MS 50
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ONLYDIR)
 
 typedef struct
 {
-	Stmt *statements;
-} Module;
+	int wd;
+	char *path;
+} WatchedDir;
 
 typedef struct
 {
-	Lexer *lexer;
-	Scope *scope;
-	bool has_errors;
-} Parser;
-
-typedef enum
-{
-	PARSE_RESULT_OK,
-	PARSE_RESULT_UNEXPECTED_TOK,
-	PARSE_RESULT_INVALID_NUMERIC_LITERAL,
-	PARSE_RESULT_CANNOT_REDECLARE,
-	PARSE_RESULT_UNDECLARED,
-	PARSE_RESULT_COULD_NOT_INFER_EXPR_TYPE,
-	PARSE_RESULT_X,
-} ParseResult;
-
-char *parse_result_name(ParseResult res)
+	int fd;
+	// stretchy buffer
+	WatchedDir *dirs;
+	// stretchy buffer of the .ts files that were written, created or removed since the last round
+	char **changed;
+	// set when events were lost, which means everything has to be looked at again
+	bool overflowed;
+} Watcher;
+
+bool has_ts_extension(const char *name)
 {
-	switch (res)
-	{
-	case PARSE_RESULT_OK:
-		return "PARSE_RESULT_OK";
-	case PARSE_RESULT_UNEXPECTED_TOK:
-		return "PARSE_RESULT_UNEXPECTED_TOK";
-	case PARSE_RESULT_INVALID_NUMERIC_LITERAL:
-		return "PARSE_RESULT_INVALID_NUMERIC_LITERAL";
-	case PARSE_RESULT_CANNOT_REDECLARE:
-		return "PARSE_RESULT_CANNOT_REDECLARE";
-	case PARSE_RESULT_UNDECLARED:
-		return "PARSE_RESULT_UNDECLARED";
-	default:
-		return "(unknown)";
-	}
+	size_t len = strlen(name);
+	return len > 3 && strcmp(name + len - 3, ".ts") == 0;
 }
 
-#define TRY_PARSE(__expr) \
-    do { \
-        ParseResult __res = __expr; \
-        if (__res != PARSE_RESULT_OK) return __res; \
-    } while (0)
-
-Parser *parser_create(Lexer *lexer)
+char *path_join(const char *dir, const char *name)
 {
-	Parser *parser = malloc(sizeof(Parser));
-	parser->lexer = lexer;
-	parser->has_errors = false;
-
-	parser->scope = malloc(sizeof(Scope));
-	scope_init(parser->scope, NULL);
-
-	Decl number_decl = decl_type_alias_create((Location){ 0 }, (Ident){ .text = "number" },
-		(Ident){ .text = "number" });
-	scope_declare(parser->scope, "number", number_decl);
-	Decl boolean_decl = decl_type_alias_create((Location){ 0 }, (Ident){ .text = "boolean" },
-		(Ident){ .text = "boolean" });
-	scope_declare(parser->scope, "boolean", boolean_decl);
-
-	return parser;
+	size_t dir_len = strlen(dir);
+	bool slash = dir_len > 0 && dir[dir_len - 1] == '/';
+	size_t len = dir_len + !slash + strlen(name) + 1;
+	char *path = malloc(len);
+	snprintf(path, len, "%s%s%s", dir, slash ? "" : "/", name);
+	return path;
 }
 
-void parser_print_error_context(Parser *parser)
+// watches `path` and every directory below it, and records every .ts file in them as changed. hidden files and
+// directories are skipped
+void watcher_add_dir(Watcher *watcher, const char *path)
 {
-	size_t pos = parser->lexer->pos;
-
-	// finding the line that the error occurred on
-	size_t line_start = pos;
-	size_t line_end = pos;
-	// first, find the start of the line, then ...
-	while (parser->lexer->source[line_start - 1] != '\n' && line_start > 0)
+	int wd = inotify_add_watch(watcher->fd, path, WATCH_EVENTS);
+	if (wd < 0)
 	{
-		line_start--;
+		fprintf(stderr, "cannot watch '%s': %s\n", path, strerror(errno));
+		return;
 	}
-	// ... find the end of the line
-	while (parser->lexer->source[line_end] != '\n' && line_end < parser->lexer->source_len)
+	// a directory that is already watched keeps its watch descriptor
+	bool known = false;
+	for (size_t i = 0; i < sbcount(watcher->dirs) && !known; i++)
 	{
-		line_end++;
+		known = watcher->dirs[i].wd == wd;
+	}
+	if (!known)
+	{
+		WatchedDir dir = { .wd = wd, .path = strdup(path) };
+		sbpush(watcher->dirs, dir);
 	}
 
-	char *current_line = substr(parser->lexer->source, line_start, line_end + 1);
-	fprintf(stderr, "%s", current_line);
-
-	size_t padding_size = pos - line_start - 1;
-	char *padding = calloc(padding_size, sizeof(char));
-	for (size_t i = 0; i < padding_size; i++)
+	struct dirent **entries;
+	int count = scandir(path, &entries, NULL, alphasort);
+	for (int i = 0; i < count; i++)
 	{
-		padding[i] = ' ';
+		const char *name = entries[i]->d_name;
+		if (name[0] != '.')
+		{
+			char *child = path_join(path, name);
+			struct stat st;
+			if (stat(child, &st) != 0)
+			{
+				// removed since it was listed. its removal is reported by an event of its own
+				free(child);
+			}
+			else if (S_ISDIR(st.st_mode))
+			{
+				watcher_add_dir(watcher, child);
+				free(child);
+			}
+			else if (S_ISREG(st.st_mode) && has_ts_extension(name))
+			{
+				sbpush(watcher->changed, child);
+			}
+			else
+			{
+				free(child);
+			}
+		}
+		free(entries[i]);
 	}
+	free(entries);
+}
+
+void watcher_read_events(Watcher *watcher)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t len = read(watcher->fd, buf, sizeof(buf));
+	const struct inotify_event *event;
+	for (char *p = buf; len > 0 && p < buf + len; p += sizeof(struct inotify_event) + event->len)
+	{
+		event = (const struct inotify_event *)p;
+		if (event->mask & IN_Q_OVERFLOW)
+		{
+			watcher->overflowed = true;
+			continue;
+		}
+
+		size_t dir = 0;
+		while (dir < sbcount(watcher->dirs) && watcher->dirs[dir].wd != event->wd)
+		{
+			dir++;
+		}
+		if (dir == sbcount(watcher->dirs))
+		{
+			continue;
+		}
+		if (event->mask & IN_IGNORED)
+		{
+			// the directory is gone
+			free(watcher->dirs[dir].path);
+			watcher->dirs[dir] = sblast(watcher->dirs);
+			stb__sbn(watcher->dirs)--;
+			continue;
+		}
+		if (event->len == 0 || event->name[0] == '.')
+		{
+			continue;
+		}
 
-	fprintf(stderr, "%s^ ", padding);
+		char *path = path_join(watcher->dirs[dir].path, event->name);
+		if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+		{
+			watcher_add_dir(watcher, path);
+			free(path);
+		}
+		else if (event->mask & IN_ISDIR)
+		{
+			// the files of a directory that was moved away or deleted are not reported one by one
+			watcher->overflowed = true;
+			free(path);
+		}
+		else if (has_ts_extension(event->name))
+		{
+			sbpush(watcher->changed, path);
+		}
+		else
+		{
+			free(path);
+		}
+	}
 }
 
-#define PARSER_ERROR(...) \
-    do {                  \
-        if (parser->has_errors) break; \
-        parser->has_errors = true; \
-        parser_print_error_context(parser); \
-        fprintf(stderr, __VA_ARGS__); \
-    } while (0)
+// blocks until something changes, then keeps reading until no event has arrived for WATCH_QUIET_MS, so that a burst of
+// writes, like an editor saving several files or a checkout, is checked once. blocking in poll keeps an idle watcher
+// off the CPU entirely
+void watcher_wait(Watcher *watcher)
+{
+	struct pollfd pfd = { .fd = watcher->fd, .events = POLLIN };
+	uint64_t first = 0;
+	while (true)
+	{
+		int timeout = -1;
+		if (sbcount(watcher->changed) > 0 || watcher->overflowed)
+		{
+			if (first == 0)
+			{
+				first = trace_clock();
+			}
+			if (trace_clock() - first >= (uint64_t)WATCH_MAX_DELAY_MS * 1000000)
+			{
+				return;
+			}
+			timeout = WATCH_QUIET_MS;
+		}
+
+		int ready = poll(&pfd, 1, timeout);
+		if (ready < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (ready < 0)
+		{
+			fprintf(stderr, "cannot wait for changes: %s\n", strerror(errno));
+			exit(1);
+		}
+		if (ready == 0)
+		{
+			return;
+		}
+		watcher_read_events(watcher);
+	}
+}
 
-bool parser_try_parse_token(Parser *parser, TokenKind kind)
+// realpath fails for a file that has been deleted, but its directory still resolves
+char *real_path_of_removed(const char *path)
 {
-	bool ok = parser->lexer->token != NULL && parser->lexer->token->kind == kind;
-	if (ok)
+	const char *slash = strrchr(path, '/');
+	char *dir = slash == NULL ? strdup(".") : strndup(path, slash == path ? 1 : (size_t)(slash - path));
+	char *real_dir = realpath(dir, NULL);
+	free(dir);
+	if (real_dir == NULL)
 	{
-		lexer_scan(parser->lexer);
+		return NULL;
 	}
-	return ok;
+	char *real_path = path_join(real_dir, slash == NULL ? path : slash + 1);
+	free(real_dir);
+	return real_path;
 }
 
-ParseResult parser_expect_token(Parser *parser, TokenKind kind)
+// forgets the imports of `file`, which have to be scanned again
+void source_file_clear_specifiers(SourceFile *file)
 {
-	bool ok = parser_try_parse_token(parser, kind);
-	if (!ok)
+	// specifiers read from a summary point into it, scanned ones are owned by the file
+	if (file->summary.header == NULL)
 	{
-		PARSER_ERROR("expected a token of kind %s, got %s\n",
-			token_kind_name(kind),
-			token_kind_name(parser->lexer->token->kind));
-		return PARSE_RESULT_UNEXPECTED_TOK;
+		for (size_t i = 0; i < sbcount(file->specifiers); i++)
+		{
+			free(file->specifiers[i]);
+		}
 	}
-	return PARSE_RESULT_OK;
+	sbfree(file->specifiers);
+	file->specifiers = NULL;
+	file->scanned = false;
+	summary_unmap(&file->summary);
 }
 
-ParseResult parse_identifier_or_literal(Parser *parser, Expr *expr)
+void program_remove_file(Program *program, size_t index)
 {
-	size_t pos = parser->lexer->pos;
-	Location location = { .pos = pos };
-	if (parser_try_parse_token(parser, TOK_IDENT))
-	{
-		*expr = expr_ident_create(location, parser->lexer->prev_token->text);
-		return PARSE_RESULT_OK;
-	}
+	SourceFile *file = &program->files[index];
+	source_file_clear_specifiers(file);
+	source_file_clear_result(file);
+	source_file_free_source(file);
+	file->source_len = 0;
+	file->up_to_date = false;
+	file->removed = true;
+}
 
-	if (parser_try_parse_token(parser, TOK_NUMBER))
+// reads the file at `index` again. it only has to be checked again if its contents really changed, which they often
+// don't, e.g. when an editor saves a file that wasn't modified
+void program_reload_file(Program *program, size_t index)
+{
+	char *source;
+	size_t source_len;
+	if (read_file_to_string(program->files[index].path, &source, &source_len) != 0)
 	{
-		char *end_ptr;
-		double value = strtod(parser->lexer->token->text, &end_ptr);
-		if (errno == ERANGE)
-		{
-			PARSER_ERROR("could not parse as double: %s\n", parser->lexer->token->text);
-			return PARSE_RESULT_INVALID_NUMERIC_LITERAL;
-		}
-		*expr = expr_num_create(location, value);
-		return PARSE_RESULT_OK;
+		program_remove_file(program, index);
+		return;
 	}
 
-	if (parser_try_parse_token(parser, TOK_BOOL))
+	SourceFile *file = &program->files[index];
+	if (source_len == file->source_len && memcmp(source, file->source, source_len) == 0)
 	{
-		bool value = STRNCMP(parser->lexer->prev_token->text, "true");
-		*expr = expr_bool_create(location, value);
-		return PARSE_RESULT_OK;
+		free(source);
+		return;
 	}
 
-	PARSER_ERROR("expected identifier or a literal but got %s\n", token_kind_name(parser->lexer->token->kind));
-	return PARSE_RESULT_UNEXPECTED_TOK;
+	source_file_clear_specifiers(file);
+	source_file_clear_result(file);
+	source_file_free_source(file);
+	program_set_source(program, file, source, source_len, false);
+	file->up_to_date = false;
 }
 
-ParseResult parse_expression(Parser *parser, Expr *expr)
+void program_apply_change(Program *program, const char *path)
 {
-	size_t pos = parser->lexer->pos;
-	Location location = { .pos = pos };
-
-	TRY_PARSE(parse_identifier_or_literal(parser, expr));
-
-	if (expr->kind == EXPR_IDENT && !scope_is_declared(parser->scope, expr->ident.text))
+	char *real_path = realpath(path, NULL);
+	if (real_path == NULL)
 	{
-		PARSER_ERROR("cannot reference '%s' before declaration\n", expr->ident.text);
-		return PARSE_RESULT_UNDECLARED;
+		real_path = real_path_of_removed(path);
+		size_t index = real_path == NULL ? FILE_NOT_FOUND : program_find_file(program, real_path);
+		// when a whole directory was removed, not even the real path of the file can be found anymore
+		for (size_t i = 0; i < sbcount(program->files) && index == FILE_NOT_FOUND; i++)
+		{
+			if (!program->files[i].removed && strcmp(program->files[i].path, path) == 0)
+			{
+				index = i;
+			}
+		}
+		if (index != FILE_NOT_FOUND)
+		{
+			program_remove_file(program, index);
+		}
+		free(real_path);
+		return;
 	}
 
-	if (expr->kind == EXPR_IDENT && parser_try_parse_token(parser, TOK_EQ))
+	size_t index = program_find_file(program, real_path);
+	free(real_path);
+	if (index != FILE_NOT_FOUND)
 	{
-		Expr *value = malloc(sizeof(Expr));
-		TRY_PARSE(parse_expression(parser, value));
-		*expr = expr_assignment_create(location, expr->ident, value);
+		program_reload_file(program, index);
+	}
+	else if (is_regular_file(path))
+	{
+		program_add_file(program, path);
 	}
-
-	return PARSE_RESULT_OK;
 }
 
-ParseResult parse_identifier(Parser *parser, Ident *ident)
+// drops the import graph of the previous round, since any change may have added, removed or redirected imports.
+// files stuck in an import cycle were never checked, so they have nothing to keep
+void program_reset_graph(Program *program)
 {
-	Expr expr;
-	TRY_PARSE(parse_identifier_or_literal(parser, &expr));
-	if (expr.kind == EXPR_IDENT)
+	for (size_t i = 0; i < sbcount(program->files); i++)
 	{
-		*ident = expr.ident;
-		return PARSE_RESULT_OK;
+		SourceFile *file = &program->files[i];
+		sbfree(file->deps);
+		file->deps = NULL;
+		sbfree(file->dependents);
+		file->dependents = NULL;
+		file->pending_deps = 0;
+		file->checked = file->removed;
+		file->rechecked = false;
+		if (file->result == PARSE_RESULT_IMPORT_CYCLE)
+		{
+			source_file_clear_result(file);
+			file->up_to_date = false;
+		}
 	}
-
-	PARSER_ERROR("expected identifier but got a literal?!\n");
-	return PARSE_RESULT_UNEXPECTED_TOK;
+	sbfree(program->ready);
+	program->ready = NULL;
+	program->ready_head = 0;
+	program->running = 0;
 }
 
-ParseResult parse_stmt(Parser *parser, Stmt *stmt)
+// checks every .ts file under `dir`, then checks again whenever files change, until interrupted. only files whose
+// source changed, and files whose imports changed their exported interface, are checked again. everything else keeps
+// its result from an earlier round
+int program_watch(Program *program, const char *dir, size_t jobs)
 {
-	size_t pos = parser->lexer->pos;
-	Location location = { .pos = pos };
-
-	if (parser_try_parse_token(parser, TOK_LET))
+	Watcher watcher = { .fd = inotify_init1(IN_CLOEXEC), .dirs = NULL, .changed = NULL, .overflowed = false };
+	if (watcher.fd < 0)
 	{
-		// let $name: $type_name = $expr;
-		Ident name;
-		TRY_PARSE(parse_identifier(parser, &name));
+		fprintf(stderr, "cannot watch '%s': %s\n", dir, strerror(errno));
+		return 1;
+	}
+	watcher_add_dir(&watcher, dir);
+	if (sbcount(watcher.dirs) == 0)
+	{
+		return 1;
+	}
 
-		if (scope_is_declared(parser->scope, name.text))
+	while (true)
+	{
+		uint64_t start = trace_clock();
+		if (watcher.overflowed)
+		{
+			// look at every known file, which notices removed ones, and at every file under the directory, which
+			// notices new ones
+			for (size_t i = 0; i < sbcount(program->files); i++)
+			{
+				if (!program->files[i].removed)
+				{
+					sbpush(watcher.changed, strdup(program->files[i].path));
+				}
+			}
+			watcher_add_dir(&watcher, dir);
+			watcher.overflowed = false;
+		}
+		for (size_t i = 0; i < sbcount(watcher.changed); i++)
 		{
-			PARSER_ERROR("cannot redeclare symbol '%s'\n", name.text);
-			return PARSE_RESULT_CANNOT_REDECLARE;
+			program_apply_change(program, watcher.changed[i]);
+			free(watcher.changed[i]);
 		}
+		sbfree(watcher.changed);
+		watcher.changed = NULL;
 
-		Ident *type_name = NULL;
-		if (parser_try_parse_token(parser, TOK_COLON))
+		program_reset_graph(program);
+		program_discover_imports(program);
+		program_check(program, jobs);
+		int status = program_report(program);
+
+		size_t count = 0;
+		size_t rechecked = 0;
+		for (size_t i = 0; i < sbcount(program->files); i++)
 		{
-			type_name = malloc(sizeof(Ident));
-			TRY_PARSE(parse_identifier(parser, type_name));
+			count += !program->files[i].removed;
+			rechecked += program->files[i].rechecked;
+		}
+		uint64_t elapsed = trace_clock() - start;
+		fprintf(stderr, "checked %zu of %zu files in %" PRIu64 ".%03" PRIu64 " ms, %s\n", rechecked, count,
+			elapsed / 1000000, elapsed / 1000 % 1000, status == 0 ? "no errors" : "found errors");
+		fflush(stderr);
+
+		watcher_wait(&watcher);
+	}
+}
+#endif
 
-			if (!(
-				STRNCMP(type_name->text, "number") ||
-				STRNCMP(type_name->text, "boolean") ||
-				scope_is_declared(parser->scope, type_name->text)
-			))
+int main(int argc, char **argv)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t jobs = cpus > 0 ? (size_t)cpus : 1;
+	char **paths = NULL;
+	const char *summary_dir = NULL;
+	const char *emit_ast_path = NULL;
+	bool verify_ast = false;
+	size_t max_expr_depth = DEFAULT_MAX_EXPR_DEPTH;
+	bool stream = false;
+	bool perf_counters = false;
+	const char *trace_path = NULL;
+	char **query_roots = NULL;
+	const char *watch_dir = NULL;
+	size_t *hover_positions = NULL;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--jobs") == 0 || strcmp(argv[i], "-j") == 0)
+		{
+			if (i + 1 >= argc || atol(argv[i + 1]) <= 0)
 			{
-				PARSER_ERROR("cannot reference type '%s' before declaration\n", type_name->text);
-				return PARSE_RESULT_UNDECLARED;
+				fprintf(stderr, "%s expects a positive number of threads\n", argv[i]);
+				return 1;
 			}
+			jobs = atol(argv[++i]);
 		}
-
-		TRY_PARSE(parser_expect_token(parser, TOK_EQ));
-
-		Expr init;
-		TRY_PARSE(parse_expression(parser, &init));
-
-		if (type_name != NULL)
+		else if (strcmp(argv[i], "--summaries") == 0)
 		{
-			// if the decl includes a kind, check that the kind of the expr matches the stated kind
-			Type expr_ty;
-			bool ok = expr_infer_type(init, parser->scope, &expr_ty);
-			if (!ok)
+			if (i + 1 >= argc)
 			{
-				PARSER_ERROR("could not infer type of expression\n");
-				return PARSE_RESULT_COULD_NOT_INFER_EXPR_TYPE;
+				fprintf(stderr, "%s expects a directory\n", argv[i]);
+				return 1;
 			}
-
-			Decl type_name_decl;
-			ok = scope_get_value(parser->scope, type_name->text, &type_name_decl);
-			if (!ok)
+			summary_dir = argv[++i];
+		}
+		else if (strcmp(argv[i], "--emit-ast") == 0)
+		{
+			if (i + 1 >= argc)
 			{
-				PARSER_ERROR("cannot reference type '%s' before declaration\n", type_name->text);
-				return PARSE_RESULT_UNDECLARED;
+				fprintf(stderr, "%s expects an output path\n", argv[i]);
+				return 1;
 			}
-			if (type_name_decl.kind != DECL_TYPE_ALIAS)
+			emit_ast_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--verify-ast") == 0)
+		{
+			verify_ast = true;
+		}
+		else if (strcmp(argv[i], "--stream") == 0)
+		{
+			stream = true;
+		}
+		else if (strcmp(argv[i], "--trace") == 0)
+		{
+			if (i + 1 >= argc)
 			{
-				PARSER_ERROR("omg what have you done\n");
-				return PARSE_RESULT_X;
+				fprintf(stderr, "%s expects an output path\n", argv[i]);
+				return 1;
 			}
-
-			Type named_ty;
-			const char *type_name_s = type_name_decl.type_alias.type_name.text;
-			if (STRNCMP(type_name_s, "number"))
+			trace_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--query") == 0)
+		{
+			if (i + 1 >= argc)
 			{
-				named_ty = TYPE_NUMBER;
+				fprintf(stderr, "%s expects a comma separated list of names\n", argv[i]);
+				return 1;
 			}
-			else if (STRNCMP(type_name_s, "boolean"))
+			for (char *name = strtok(argv[++i], ","); name != NULL; name = strtok(NULL, ","))
 			{
-				named_ty = TYPE_BOOL;
+				sbpush(query_roots, name);
 			}
-			else
+		}
+		else if (strcmp(argv[i], "--hover") == 0)
+		{
+			if (i + 1 >= argc)
 			{
-				return PARSE_RESULT_UNDECLARED; // todo: do something else
+				fprintf(stderr, "%s expects a comma separated list of byte offsets\n", argv[i]);
+				return 1;
 			}
-
-			if (expr_ty.id != named_ty.id)
+			for (char *offset = strtok(argv[++i], ","); offset != NULL; offset = strtok(NULL, ","))
 			{
-				PARSER_ERROR("type mismatch\n");
-				return PARSE_RESULT_UNEXPECTED_TOK;
+				char *end;
+				errno = 0;
+				unsigned long long pos = strtoull(offset, &end, 10);
+				if (errno != 0 || *end != '\0' || !is_digit(*offset))
+				{
+					fprintf(stderr, "--hover expects byte offsets, got '%s'\n", offset);
+					return 1;
+				}
+				sbpush(hover_positions, (size_t)pos);
 			}
 		}
-
-		Decl decl = decl_let_create(location, name, type_name, init);
-		*stmt = stmt_decl_create(location, decl);
-
-		scope_declare(parser->scope, name.text, decl);
-	}
-	else if (parser_try_parse_token(parser, TOK_TYPE))
-	{
-		// type $name = $type_name;
-		Ident name;
-		TRY_PARSE(parse_identifier(parser, &name));
-
-		if (scope_is_declared(parser->scope, name.text))
+		else if (strcmp(argv[i], "--watch") == 0)
 		{
-			PARSER_ERROR("cannot redeclare symbol '%s'\n", name.text);
-			return PARSE_RESULT_CANNOT_REDECLARE;
+			if (i + 1 >= argc)
+			{
+				fprintf(stderr, "%s expects a directory\n", argv[i]);
+				return 1;
+			}
+			watch_dir = argv[++i];
 		}
+		else if (strcmp(argv[i], "--perf-counters") == 0)
+		{
+			perf_counters = true;
+		}
+		else if (strcmp(argv[i], "--max-depth") == 0)
+		{
+			if (i + 1 >= argc || atol(argv[i + 1]) <= 0)
+			{
+				fprintf(stderr, "%s expects a positive number of levels\n", argv[i]);
+				return 1;
+			}
+			max_expr_depth = atol(argv[++i]);
+		}
+		else if (strncmp(argv[i], "--", 2) == 0)
+		{
+			fprintf(stderr, "unrecognised flag '%s'\n", argv[i]);
+			return 1;
+		}
+		else
+		{
+			sbpush(paths, argv[i]);
+		}
+	}
 
-		TRY_PARSE(parser_expect_token(parser, TOK_EQ));
-
-		Ident type_name;
-		TRY_PARSE(parse_identifier(parser, &type_name));
+	if (stream && (emit_ast_path != NULL || verify_ast))
+	{
+		fprintf(stderr, "--stream does not keep the AST, so it cannot be combined with --emit-ast or --verify-ast\n");
+		return 1;
+	}
+	if (query_roots != NULL && (stream || emit_ast_path != NULL || verify_ast))
+	{
+		fprintf(stderr, "--query only checks part of the file, so it cannot be combined with --stream, --emit-ast or "
+			"--verify-ast\n");
+		return 1;
+	}
 
-		Decl decl = decl_type_alias_create(location, name, type_name);
-		*stmt = stmt_decl_create(location, decl);
+	if (hover_positions != NULL && query_roots != NULL)
+	{
+		fprintf(stderr, "--query only checks part of the file, so it cannot be combined with --hover\n");
+		return 1;
+	}
 
-		scope_declare(parser->scope, name.text, decl);
+	if (watch_dir != NULL && (sbcount(paths) > 0 || stream || query_roots != NULL || emit_ast_path != NULL || verify_ast ||
+		trace_path != NULL || perf_counters || hover_positions != NULL))
+	{
+		fprintf(stderr, "--watch checks every file under its directory until it is interrupted, so it cannot be combined "
+			"with other paths, --stream, --query, --emit-ast, --verify-ast, --trace, --perf-counters or --hover\n");
+		return 1;
 	}
-	else
+
+	// started before any file is read, so that reading is counted too
+	if (perf_counters && !perf_start())
 	{
-		// $expr;
-		Expr expr;
-		TRY_PARSE(parse_expression(parser, &expr));
-		*stmt = stmt_expr_create(location, expr);
+		fprintf(stderr, "hardware performance counters are unavailable (%s), continuing without them. "
+			"/proc/sys/kernel/perf_event_paranoid may restrict them\n", strerror(errno));
+		perf_counters = false;
 	}
 
-	TRY_PARSE(parser_expect_token(parser, TOK_SEMICOLON));
-	return PARSE_RESULT_OK;
-}
+	if (trace_path != NULL)
+	{
+		trace_enable();
+	}
 
-void parser_synchronize(Parser *parser)
-{
-	lexer_scan(parser->lexer);
+	Program program;
+	program_init(&program);
+	program.max_expr_depth = max_expr_depth;
+	program.stream = stream;
+	program.query_roots = query_roots;
+	program.hover_positions = hover_positions;
 
-	while (!lexer_has_more_chars(parser->lexer))
+	if (summary_dir != NULL)
 	{
-		Token *prev_token = parser->lexer->prev_token;
-		if (prev_token != NULL && prev_token->kind == TOK_SEMICOLON)
-		{
-			return;
-		}
-
-		switch (parser->lexer->token->kind)
+		if (mkdir(summary_dir, 0777) != 0 && errno != EEXIST)
 		{
-		case TOK_LET:
-		case TOK_FUNCTION:
-		case TOK_TYPE:
-		case TOK_RETURN:
-			return;
-		default:
-			break;
+			fprintf(stderr, "cannot create summary directory '%s': %s\n", summary_dir, strerror(errno));
+			return 1;
 		}
-
-		lexer_scan(parser->lexer);
+		program.summary_dir = summary_dir;
 	}
-}
 
-ParseResult parser_parse_module(Parser *parser, Module *mod)
-{
-	lexer_scan(parser->lexer);
-	if (parser_try_parse_token(parser, TOK_END_OF_FILE))
+	if (watch_dir != NULL)
 	{
-		return PARSE_RESULT_OK;
+#ifdef __linux__
+		return program_watch(&program, watch_dir, jobs);
+#else
+		fprintf(stderr, "--watch needs inotify, which is only available on Linux\n");
+		return 1;
+#endif
 	}
 
-	// module-level scope
-	Scope scope;
-	scope_init(&scope, NULL);
-
-	ParseResult res;
-	while (true)
+	if (sbcount(paths) == 0)
 	{
-		Stmt stmt;
-		res = parse_stmt(parser, &stmt);
-		if (res != PARSE_RESULT_OK)
+		char *source = "let a: boolean = false;\n"
+			 "let b: number = 1;\n"
+			 "let c: boolean = b;\n";
+		program_add_source(&program, "<builtin>", "<builtin>", source, strlen(source), false);
+	}
+	for (size_t i = 0; i < sbcount(paths); i++)
+	{
+		if (program_add_file(&program, paths[i]) == FILE_NOT_FOUND)
 		{
-			parser_synchronize(parser);
-			parser->has_errors = false;
+			fprintf(stderr, "cannot read file '%s'\n", paths[i]);
+			return 1;
 		}
-		sbpush(mod->statements, stmt);
+	}
 
-		if (parser_try_parse_token(parser, TOK_END_OF_FILE))
-		{
-			break;
-		}
+	if (emit_ast_path != NULL || verify_ast || query_roots != NULL || hover_positions != NULL)
+	{
+		// the first file must be parsed even if it has an up to date summary, for its AST, its non-exported names or
+		// its identifiers
+		summary_unmap(&program.files[0].summary);
 	}
 
-	return res;
-}
+	uint64_t trace_start = trace_begin();
+	program_discover_imports(&program);
+	trace_end("discover imports", trace_start);
 
-ParseResult parser_parse(Parser *parser, Module *module)
-{
-	return parser_parse_module(parser, module);
-}
+	trace_start = trace_begin();
+	program_check(&program, jobs);
+	trace_end("check program", trace_start);
 
-int read_file_to_string(const char *filename, char **str)
-{
-	long length;
-	FILE *f = fopen(filename, "rb");
-	if (f)
+	if (trace_path != NULL && !trace_write(trace_path))
 	{
-		fseek(f, 0, SEEK_END);
-		length = ftell(f);
-		fseek(f, 0, SEEK_SET);
-		*str = malloc(length);
-		if (*str)
-		{
-			fread(*str, 1, length, f);
-		}
-		else
-		{
-			return 1;
-		}
-		fclose(f);
+		fprintf(stderr, "cannot write trace to '%s': %s\n", trace_path, strerror(errno));
+		return 1;
 	}
-	return 0;
-}
 
-int main(int argc, char **argv)
-{
-	char *source;
-	if (argc > 1)
+	if ((emit_ast_path != NULL || verify_ast) && !emit_ast(&program.files[0], emit_ast_path, verify_ast))
 	{
-		read_file_to_string(argv[1], &source);
+		return 1;
 	}
-	else
+
+	if (perf_counters)
 	{
-		source = "let a: boolean = false;\n"
-			 "let b: number = 1;\n"
-			 "let c: boolean = b;\n";
+		perf_report(stdout);
 	}
 
-	Parser *parser = parser_create(lexer_create(source));
-
-	Module mod = { .statements = NULL };
-	ParseResult res = parser_parse(parser, &mod);
+	if (program.files[0].answers != NULL)
+	{
+		fwrite(program.files[0].answers, 1, program.files[0].answers_len, stdout);
+	}
 
-	if (res != PARSE_RESULT_OK)
+	if (hover_positions != NULL)
 	{
-		fprintf(stderr, "failed to parse: %s\n", parse_result_name(res));
-		return 1;
+		hover_report(&program.files[0], hover_positions, stdout);
 	}
 
-	return 0;
+	return program_report(&program);
 }
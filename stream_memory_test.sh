@@ -0,0 +1,109 @@
+#!/usr/bin/env bash
+
+set -euo pipefail
+
+BOLD=$(tput bold 2>/dev/null || true)
+NORMAL=$(tput sgr0 2>/dev/null || true)
+
+log_info() {
+  echo -e "${BOLD}stream_memory_test.sh INFO: $@${NORMAL}" >&2
+}
+
+usage() {
+    cat <<USAGE
+Generates a module with N typed declarations, checks it with and without --stream and compares the peak resident
+memory of the two runs. The test fails if the run with --stream does not stay below the given fraction of the other,
+which catches declarations that are kept whole after their statements have been freed.
+
+usage: $0 --bin \$path_to_binary [--n N] [--max-ratio R]
+
+flags:
+  --bin:       path to the binary under test
+  --n:         number of declarations in the module (default: 300000)
+  --max-ratio: the largest peak memory with --stream, as a fraction of the peak without it (default: 0.5)
+USAGE
+}
+
+# prints the peak resident memory in KiB of running the given command, which has to succeed
+peak_kib() {
+  python3 -c '
+import resource, subprocess, sys
+subprocess.run(sys.argv[1:], stdout=subprocess.DEVNULL, check=True)
+print(resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss)
+' "$@"
+}
+
+gen_typed_declarations() {
+  awk -v n="$1" 'BEGIN {
+    print "type count = number;"
+    for (i = 0; i < n; i++) print "let declaration_" i ": count = " i ";"
+    print "let last: number = declaration_0;"
+  }'
+}
+
+main() {
+  if [[ $# -lt 1 ]]
+  then
+    usage
+    exit 1
+  fi
+
+  local bin
+  local n=300000
+  local max_ratio=0.5
+  while [[ $# -gt 0 ]]
+  do
+    local key="$1"
+    case "$key" in
+    help | --usage | --help)
+      usage
+      exit
+      ;;
+    --bin)
+      bin="$2"
+      shift 2
+      ;;
+    --n)
+      n="$2"
+      shift 2
+      ;;
+    --max-ratio)
+      max_ratio="$2"
+      shift 2
+      ;;
+    *)
+      echo "unrecognised argument '$key'. run \`$0 help\` to display usage information"
+      exit 1
+      ;;
+    esac
+  done
+
+  if [[ ! -x "$bin" ]]
+  then
+    echo "no such executable '$bin'"
+    exit 1
+  fi
+
+  local tmpdir
+  tmpdir=$(mktemp -d /tmp/single_pass_tsc_stream_memory.XXXXXX)
+  trap "rm -rf '$tmpdir'" EXIT
+
+  local input="$tmpdir/declarations.ts"
+  log_info "generating $n typed declarations"
+  gen_typed_declarations "$n" > "$input"
+
+  log_info "checking with and without --stream"
+  local full stream
+  full=$(peak_kib "$bin" "$input")
+  stream=$(peak_kib "$bin" --stream "$input")
+  printf '%-16s %10d KiB\n' "without --stream" "$full"
+  printf '%-16s %10d KiB\n' "with --stream" "$stream"
+
+  if awk -v a="$stream" -v b="$full" -v max="$max_ratio" 'BEGIN { exit !(a > b * max) }'
+  then
+    echo "the peak memory with --stream is above $max_ratio of the peak without it"
+    exit 1
+  fi
+}
+
+main "$@"
@@ -0,0 +1,96 @@
+#!/usr/bin/env bash
+
+set -euo pipefail
+
+BOLD=$(tput bold 2>/dev/null || true)
+NORMAL=$(tput sgr0 2>/dev/null || true)
+
+log_info() {
+  echo -e "${BOLD}summary_cache_test.sh INFO: $@${NORMAL}" >&2
+}
+
+usage() {
+    cat <<USAGE
+Checks a small program with --summaries twice: the first run writes a summary for every module, the second run must
+reuse all of them without checking any module again. The modules include one with neither imports nor exports, whose
+summary has empty sections. Both runs must succeed.
+
+usage: $0 --bin \$path_to_binary
+
+flags:
+  --bin: path to the binary under test, which should be an optimized build
+USAGE
+}
+
+main() {
+  if [[ $# -lt 1 ]]
+  then
+    usage
+    exit 1
+  fi
+
+  local bin
+  while [[ $# -gt 0 ]]
+  do
+    local key="$1"
+    case "$key" in
+    help | --usage | --help)
+      usage
+      exit
+      ;;
+    --bin)
+      bin="$2"
+      shift 2
+      ;;
+    *)
+      echo "unrecognised argument '$key'. run \`$0 help\` to display usage information"
+      exit 1
+      ;;
+    esac
+  done
+
+  if [[ ! -x "$bin" ]]
+  then
+    echo "no such executable '$bin'"
+    exit 1
+  fi
+
+  local tmpdir
+  tmpdir=$(mktemp -d /tmp/single_pass_tsc_summaries.XXXXXX)
+  trap "rm -rf '$tmpdir'" EXIT
+
+  # exports without imports, imports without exports, and neither
+  echo 'export let one = 1; export type Num = number;' > "$tmpdir/lib.ts"
+  echo 'import { one, Num } from "./lib"; let two: Num = one;' > "$tmpdir/main.ts"
+  echo 'let alone = true;' > "$tmpdir/alone.ts"
+  mkdir "$tmpdir/summaries"
+
+  for run in 1 2
+  do
+    log_info "run $run"
+    local status=0
+    "$bin" --summaries "$tmpdir/summaries" --trace "$tmpdir/trace_$run.json" \
+      "$tmpdir/lib.ts" "$tmpdir/main.ts" "$tmpdir/alone.ts" || status=$?
+    if [[ "$status" -ne 0 ]]
+    then
+      echo "run $run exited with status $status"
+      exit 1
+    fi
+  done
+
+  local written
+  written=$(find "$tmpdir/summaries" -name '*.tsum' | wc -l)
+  if [[ "$written" -ne 3 ]]
+  then
+    echo "expected a summary for each of the 3 modules, found $written"
+    exit 1
+  fi
+
+  if grep -q '"parse and check"' "$tmpdir/trace_2.json"
+  then
+    echo "the second run checked a module again instead of using its summary"
+    exit 1
+  fi
+}
+
+main "$@"
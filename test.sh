@@ -2,8 +2,8 @@
 
 set -euo pipefail
 
-BOLD=$(tput bold)
-NORMAL=$(tput sgr0)
+BOLD=$(tput bold 2>/dev/null || true)
+NORMAL=$(tput sgr0 2>/dev/null || true)
 
 log_info() {
   echo -e "${BOLD}test.sh INFO: $@${NORMAL}"
@@ -13,7 +13,8 @@ usage() {
     cat <<USAGE
 Compares the output of a program with the expected output saved in files (AKA "snapshot" tests). Input and output files
 are located under the fixtures/ directory. The .input file is passed as input to the program, then the data that program
-writes to stderr and stdout are compared with the corresponding .stderr and .stdout files.
+writes to stderr and stdout are compared with the corresponding .stderr and .stdout files. If there is a corresponding
+.args file, the flags in it are passed to the program before the input.
 
 usage: $0 --bin \$path_to_binary [--update]
 
@@ -79,8 +80,16 @@ main() {
     local want_stderr="./fixtures/$name.stderr"
     local got_stderr="$tmpdir/$name.stderr"
 
+    local args=()
+    if [[ -f "./fixtures/$name.args" ]]
+    then
+      read -r -a args < "./fixtures/$name.args"
+    fi
+
     log_info "testing $name"
-    "$bin" "$input" > >(tee "$got_stdout") 2> >(tee "$got_stderr" >&2) || true # swallow errors
+    "$bin" "${args[@]}" "$input" > "$got_stdout" 2> "$got_stderr" || true # swallow errors
+    cat "$got_stdout"
+    cat "$got_stderr" >&2
     git diff --no-index "$want_stdout" "$got_stdout" || has_errs='true'
     git diff --no-index "$want_stderr" "$got_stderr" || has_errs='true'
 
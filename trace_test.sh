@@ -0,0 +1,148 @@
+#!/usr/bin/env bash
+
+set -euo pipefail
+
+BOLD=$(tput bold 2>/dev/null || true)
+NORMAL=$(tput sgr0 2>/dev/null || true)
+
+log_info() {
+  echo -e "${BOLD}trace_test.sh INFO: $@${NORMAL}" >&2
+}
+
+usage() {
+    cat <<USAGE
+Checks a program of several modules with --trace, once on a single thread and once on several, and parses the trace.
+Every module must have a read, a scan imports and a check span labelled with its path, every parse and check span must
+be nested in the check span of its module on the same thread, and every span must be nested in the phase of the run it
+belongs to. One of the paths has a quote, a backslash and a space in it, so that escaping is checked too.
+
+usage: $0 --bin \$path_to_binary
+
+flags:
+  --bin: path to the binary under test
+USAGE
+}
+
+# checks the trace in $1 of a run that checked the paths after it
+check_trace() {
+  python3 - "$@" <<'PYTHON'
+import json, os, sys
+
+trace_path, paths = sys.argv[1], sys.argv[2:]
+with open(trace_path) as f:
+    events = json.load(f)["traceEvents"]
+
+errors = []
+threads = {e["tid"] for e in events if e["ph"] == "M" and e["name"] == "thread_name"}
+spans = [e for e in events if e["ph"] == "X"]
+for span in spans:
+    if span["tid"] not in threads:
+        errors.append(f"span '{span['name']}' is on thread {span['tid']}, which has no name")
+
+def within(inner, outer):
+    return outer["ts"] <= inner["ts"] and inner["ts"] + inner["dur"] <= outer["ts"] + outer["dur"] + 0.001
+
+def only(cat):
+    found = [s for s in spans if s["cat"] == cat]
+    if len(found) != 1:
+        errors.append(f"expected one '{cat}' span, found {len(found)}")
+    return found[0] if found else None
+
+discover = only("discover imports")
+program = only("check program")
+
+for path in paths:
+    for cat in ("read", "scan imports", "check"):
+        found = [s for s in spans if s["cat"] == cat and s["args"].get("file") == path]
+        if len(found) != 1:
+            errors.append(f"expected one '{cat}' span of '{path}', found {len(found)}")
+            continue
+        span = found[0]
+        if span["name"] != f"{cat} {path}":
+            errors.append(f"the '{cat}' span of '{path}' is named '{span['name']}'")
+        if span["args"].get("bytes") != os.path.getsize(path):
+            errors.append(f"the '{cat}' span of '{path}' has {span['args'].get('bytes')} bytes")
+        if cat == "scan imports" and discover is not None and not within(span, discover):
+            errors.append(f"the '{cat}' span of '{path}' is outside of 'discover imports'")
+        if cat == "check":
+            if span["args"].get("result") != "PARSE_RESULT_OK":
+                errors.append(f"'{path}' was checked with result {span['args'].get('result')}")
+            if program is not None and not within(span, program):
+                errors.append(f"the '{cat}' span of '{path}' is outside of 'check program'")
+
+checks = [s for s in spans if s["cat"] == "check"]
+for span in spans:
+    if span["cat"] == "parse and check":
+        if not any(c["tid"] == span["tid"] and within(span, c) for c in checks):
+            errors.append(f"a 'parse and check' span on thread {span['tid']} is outside of every 'check' span")
+
+for error in errors:
+    print(error)
+sys.exit(1 if errors else 0)
+PYTHON
+}
+
+main() {
+  if [[ $# -lt 1 ]]
+  then
+    usage
+    exit 1
+  fi
+
+  local bin
+  while [[ $# -gt 0 ]]
+  do
+    local key="$1"
+    case "$key" in
+    help | --usage | --help)
+      usage
+      exit
+      ;;
+    --bin)
+      bin="$2"
+      shift 2
+      ;;
+    *)
+      echo "unrecognised argument '$key'. run \`$0 help\` to display usage information"
+      exit 1
+      ;;
+    esac
+  done
+
+  if [[ ! -x "$bin" ]]
+  then
+    echo "no such executable '$bin'"
+    exit 1
+  fi
+
+  local tmpdir
+  tmpdir=$(mktemp -d /tmp/single_pass_tsc_trace.XXXXXX)
+  trap "rm -rf '$tmpdir'" EXIT
+
+  # a chain of imports, and a module on its own with an awkward name
+  local odd='odd "name\ here.ts'
+  echo 'export let one = 1; export type Num = number;' > "$tmpdir/lib.ts"
+  echo 'import { one, Num } from "./lib"; export let two: Num = one;' > "$tmpdir/middle.ts"
+  echo 'import { two } from "./middle"; let three: number = two;' > "$tmpdir/main.ts"
+  echo 'let alone = true;' > "$tmpdir/$odd"
+  local paths=("$tmpdir/lib.ts" "$tmpdir/middle.ts" "$tmpdir/main.ts" "$tmpdir/$odd")
+
+  for jobs in 1 4
+  do
+    log_info "checking with $jobs jobs"
+    local status=0
+    "$bin" --jobs "$jobs" --trace "$tmpdir/trace_$jobs.json" "${paths[@]}" || status=$?
+    if [[ "$status" -ne 0 ]]
+    then
+      echo "the run with $jobs jobs exited with status $status"
+      exit 1
+    fi
+    if ! check_trace "$tmpdir/trace_$jobs.json" "${paths[@]}"
+    then
+      echo "the trace of the run with $jobs jobs is wrong"
+      exit 1
+    fi
+  done
+}
+
+main "$@"
@@ -0,0 +1,137 @@
+#!/usr/bin/env bash
+
+set -euo pipefail
+
+BOLD=$(tput bold 2>/dev/null || true)
+NORMAL=$(tput sgr0 2>/dev/null || true)
+
+log_info() {
+  echo -e "${BOLD}watch_test.sh INFO: $@${NORMAL}" >&2
+}
+
+usage() {
+    cat <<USAGE
+Starts --watch on a directory with a chain of imports and a module on its own, then edits, deletes and adds modules.
+After each change, the round it triggers must check exactly the modules that changed and the importers whose imports
+changed their exported interface, and must report errors only while a module is missing.
+
+usage: $0 --bin \$path_to_binary [--timeout SECONDS]
+
+flags:
+  --bin:     path to the binary under test
+  --timeout: how long to wait for each round to be reported (default: 10)
+USAGE
+}
+
+main() {
+  if [[ $# -lt 1 ]]
+  then
+    usage
+    exit 1
+  fi
+
+  local bin
+  local timeout=10
+  while [[ $# -gt 0 ]]
+  do
+    local key="$1"
+    case "$key" in
+    help | --usage | --help)
+      usage
+      exit
+      ;;
+    --bin)
+      bin="$2"
+      shift 2
+      ;;
+    --timeout)
+      timeout="$2"
+      shift 2
+      ;;
+    *)
+      echo "unrecognised argument '$key'. run \`$0 help\` to display usage information"
+      exit 1
+      ;;
+    esac
+  done
+
+  if [[ ! -x "$bin" ]]
+  then
+    echo "no such executable '$bin'"
+    exit 1
+  fi
+
+  local tmpdir
+  tmpdir=$(mktemp -d /tmp/single_pass_tsc_watch.XXXXXX)
+  local dir="$tmpdir/src"
+  local log="$tmpdir/watch.log"
+  mkdir "$dir"
+
+  # main imports mid, which imports lib. the type of each export is inferred from the one it imports, so a change to
+  # the type of lib's export changes the interface of mid too
+  echo 'export let one = 1;' > "$dir/lib.ts"
+  echo 'import { one } from "./lib"; export let two = one;' > "$dir/mid.ts"
+  echo 'import { two } from "./mid"; let three = two;' > "$dir/main.ts"
+  echo 'let alone = true;' > "$dir/alone.ts"
+
+  "$bin" --watch "$dir" 2> "$log" &
+  local pid=$!
+  trap "kill $pid 2>/dev/null; rm -rf '$tmpdir'" EXIT
+
+  local rounds=0
+  # waits for the next round and checks its summary line against $1
+  expect_round() {
+    rounds=$(( rounds + 1 ))
+    local deadline=$(( $(date +%s) + timeout ))
+    while [[ $(grep -c '^checked ' "$log" || true) -lt "$rounds" ]]
+    do
+      if [[ $(date +%s) -ge "$deadline" ]] || ! kill -0 "$pid" 2>/dev/null
+      then
+        echo "round $rounds was never reported. the log so far:"
+        cat "$log"
+        exit 1
+      fi
+      sleep 0.05
+    done
+
+    local line
+    line=$(grep '^checked ' "$log" | sed -n "${rounds}p")
+    if [[ "$line" != "checked $1 files in "* || "$line" != *", $2" ]]
+    then
+      echo "expected round $rounds to have checked $1 files with $2, but it reported '$line'. the log so far:"
+      cat "$log"
+      exit 1
+    fi
+  }
+
+  log_info "initial round"
+  expect_round "4 of 4" "no errors"
+
+  log_info "changing the interface of lib, which mid and main depend on"
+  echo 'export let one = true;' > "$dir/lib.ts"
+  expect_round "3 of 4" "no errors"
+
+  log_info "changing lib without changing its interface"
+  echo 'export let one = false;' > "$dir/lib.ts"
+  expect_round "1 of 4" "no errors"
+
+  log_info "deleting lib"
+  rm "$dir/lib.ts"
+  expect_round "2 of 3" "found errors"
+  if ! grep -q "cannot find module './lib'" "$log"
+  then
+    echo "mid was not reported for importing the deleted module. the log so far:"
+    cat "$log"
+    exit 1
+  fi
+
+  log_info "adding lib back"
+  echo 'export let one = 1;' > "$dir/lib.ts"
+  expect_round "3 of 4" "no errors"
+
+  log_info "adding a module that nothing imports"
+  echo 'let other = 2;' > "$dir/other.ts"
+  expect_round "1 of 5" "no errors"
+}
+
+main "$@"